@@ -1,8 +1,12 @@
 #ifndef COLLATZ_HPP
 #define COLLATZ_HPP
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <optional>
+#include <vector>
 
 struct range
 {
@@ -10,15 +14,293 @@ struct range
 
     range(uint64_t a, uint64_t b) : a(a), b(b) {}
 
-    inline uint64_t length() const { return (b - a) + 1; }
+    // saturated to UINT64_MAX for [0, UINT64_MAX], one value short
+    inline uint64_t length() const
+    {
+        if (a > b)
+            return 0;
+        return (b - a == UINT64_MAX) ? UINT64_MAX : (b - a) + 1;
+    }
 };
 
+/**
+ * @brief parses the ranges, in the form a-b, given from the third argument on.
+ * Malformed ranges are reported and skipped.
+ */
+std::vector<range> parse_ranges(int argc, const char** argv);
+
+/**
+ * @brief Many ranges concatenated in a single iteration space [0, size()):
+ * a chunk of global indices can be split back into the sub-ranges of the
+ * original values.
+ */
+class fused_space
+{
+public:
+    fused_space(const std::vector<range>& ranges);
+
+    inline uint64_t size() const { return m_offsets.back(); }
+
+    inline size_t count() const { return m_ranges.size(); }
+
+    inline const range& operator[](size_t r) const { return m_ranges[r]; }
+
+    /**
+     * @brief calls `func(r, sub)` for every piece `sub` of the global `chunk`
+     * falling into the r-th range.
+     */
+    template <typename Func>
+    void split(const range& chunk, Func&& func) const
+    {
+        uint64_t g = chunk.a;
+
+        // first range containing g, a chunk can span many ranges
+        size_t r = std::upper_bound(m_offsets.begin(), m_offsets.end(), g) -
+                   m_offsets.begin() - 1;
+        for (; r < m_ranges.size() && g <= chunk.b; r++)
+        {
+            uint64_t last = std::min(chunk.b, m_offsets[r + 1] - 1);
+            func(r, range(m_ranges[r].a + (g - m_offsets[r]),
+                          m_ranges[r].a + (last - m_offsets[r])));
+            g = last + 1;
+        }
+    }
+
+private:
+    std::vector<range> m_ranges;
+
+    // m_offsets[r] is the global index of the first value of the r-th range
+    std::vector<uint64_t> m_offsets;
+};
+
+/**
+ * @brief Reduction over a set of values: the total steps and the longest
+ * trajectory, whose ties are broken in favour of the smallest value.
+ */
+struct collatz_stats
+{
+    uint64_t steps = 0;
+    uint64_t max = 0;
+    uint64_t argmax = 0; // 0 while no value has been added
+
+    // true if the trajectory of n, s steps long, replaces the current one
+    inline bool longer(uint64_t n, uint64_t s) const
+    {
+        return argmax == 0 || s > max || (s == max && n < argmax);
+    }
+
+    inline void add(uint64_t n, uint64_t s)
+    {
+        steps += s;
+        if (longer(n, s))
+        {
+            max = s;
+            argmax = n;
+        }
+    }
+
+    inline void merge(const collatz_stats& other)
+    {
+        steps += other.steps;
+        if (other.argmax != 0 && longer(other.argmax, other.max))
+        {
+            max = other.max;
+            argmax = other.argmax;
+        }
+    }
+};
+
+/**
+ * @brief steps of the trajectory of n. The 64 bits arithmetic is checked for
+ * overflow and the rare trajectories exceeding it continue in 128 bits.
+ */
 uint64_t collatz_steps(uint64_t n);
 
-double sequential(const range& range);
+/**
+ * @brief highest value reached by the trajectory of n, n included, saturated
+ * to UINT64_MAX when the trajectory exceeds the 64 bits.
+ */
+uint64_t collatz_peak(uint64_t n);
+
+/**
+ * @brief Reductions answered by `collatz_engine::query`: the longest
+ * trajectory and the highest peak of a range, ties broken in favour of the
+ * smallest value.
+ */
+enum class collatz_query
+{
+    longest,
+    peak
+};
+
+struct query_result
+{
+    uint64_t value = 0;   // steps or peak of the best value
+    uint64_t argmax = 0;  // 0 if the range is empty
+    uint64_t checked = 0; // candidates actually evaluated
+};
+
+/**
+ * @brief Collatz steps counter that advances `bits` shortcut iterations at
+ * once through a precomputed jump table and terminates early as soon as the
+ * trajectory drops below `cache_bound`, where the steps are already known.
+ * Both tables are read-only after construction, so a single instance can be
+ * shared by all the workers.
+ */
+class collatz_engine
+{
+public:
+    /**
+     * @param bits number of low bits consumed by every jump, the table has
+     * 2^bits entries (must be in [1, 20]).
+     * @param cache_bound every n < cache_bound has its steps precomputed.
+     */
+    collatz_engine(uint32_t bits = 10, uint64_t cache_bound = 1UL << 20);
+
+    /**
+     * @brief returns the same value of `collatz_steps(n)`.
+     */
+    uint64_t steps(uint64_t n) const;
+
+    /**
+     * @brief returns the same value of `collatz_peak(n)`.
+     */
+    uint64_t peak(uint64_t n) const;
+
+    /**
+     * @brief answers the query `q` over `r`. With `pruning` the values that
+     * are provably beaten by a smaller or longer one of the same range are
+     * never evaluated, otherwise every value is (brute force).
+     */
+    query_result query(collatz_query q, const range& r,
+                       bool pruning = true) const;
+
+    /**
+     * @brief returns the sum of the steps and the longest trajectory of the
+     * values in `r`. Values are processed in SIMD lanes when the CPU supports
+     * AVX2 or AVX-512, a lane is refilled with the next value as soon as its
+     * trajectory terminates.
+     */
+    inline collatz_stats stats(const range& r) const
+    {
+        collatz_stats stats;
+
+        // too short ranges do not pay back the setup of the lanes
+        if (r.b - r.a < 64)
+            steps_scalar(r.a, r.b, stats);
+        else
+            (this->*m_kernel)(r.a, r.b, stats);
+
+        return stats;
+    }
+
+    /**
+     * @brief returns the sum of the steps of every value in `r`.
+     */
+    inline uint64_t steps(const range& r) const { return stats(r).steps; }
+
+    inline uint32_t bits() const { return m_bits; }
+
+    inline uint64_t cache_bound() const { return m_cache.size(); }
+
+    /**
+     * @brief name of the range kernel selected at construction time.
+     */
+    inline const char* isa() const { return m_isa; }
+
+private:
+    void steps_scalar(uint64_t a, uint64_t b, collatz_stats& stats) const;
+
+    void steps_avx2(uint64_t a, uint64_t b, collatz_stats& stats) const;
+
+    void steps_avx512(uint64_t a, uint64_t b, collatz_stats& stats) const;
+
+    // add to `stats` the cached steps of the values of [next, b] below the
+    // cache bound, stopping at the first one that needs a lane. Returns false
+    // once the range is exhausted.
+    bool next_lane(uint64_t& next, uint64_t b, collatz_stats& stats) const;
+
+    // finish on the scalar path the lanes set in `mask`, whose trajectory is
+    // at n[l] after s[l] steps from start[l]
+    void finish_lanes(uint32_t mask, const uint64_t* n, const uint64_t* s,
+                      const uint64_t* start, collatz_stats& stats) const;
+
+private:
+    // n = a * 2^bits + b  ->  a * mul + add after bits shortcut iterations
+    struct jump
+    {
+        uint32_t mul;
+        uint32_t steps;
+        uint64_t add;
+    };
+
+    uint32_t m_bits;
+    uint64_t m_mask;
+    uint64_t m_jump_bound; // largest n whose jump fits 64 bits
+    std::vector<jump> m_jumps;
+    std::vector<uint16_t> m_cache;
+    std::vector<uint64_t> m_peaks; // same bound of m_cache
+
+    void (collatz_engine::*m_kernel)(uint64_t, uint64_t, collatz_stats&) const;
+    const char* m_isa;
+};
+
+/**
+ * @brief Shared position inside a range from which the workers claim chunks
+ * through a CAS. The chunk size shrinks with the remaining work (guided
+ * self-scheduling) but never goes below `min_chunk`, so the claim cost is
+ * amortized over thousands of values. The cursor counts the values left
+ * rather than pointing at the next one, which would wrap to 0 after a range
+ * ending at UINT64_MAX.
+ */
+class alignas(64) chunk_cursor
+{
+public:
+    chunk_cursor() : m_left(0), m_end(0), m_divisor(1), m_min_chunk(1) {}
+
+    /**
+     * @param r the range to hand out, it can be empty (r.a > r.b).
+     * @param divisor every chunk is `remaining / divisor` values long.
+     * @param min_chunk lower bound of the chunk size.
+     */
+    void reset(const range& r, uint64_t divisor, uint64_t min_chunk);
+
+    /**
+     * @brief claims the next chunk or returns `std::nullopt` when the range is
+     * exhausted.
+     */
+    std::optional<range> claim();
+
+private:
+    // values not claimed yet, the next chunk starts at m_end - m_left + 1
+    std::atomic<uint64_t> m_left;
+    uint64_t m_end;
+    uint64_t m_divisor;
+    uint64_t m_min_chunk;
+};
+
+double sequential(const collatz_engine& engine, const range& range);
+
+double block_cyclic(const collatz_engine& engine, size_t workers_num,
+                    size_t chunksize, const range& range);
+
+double dynamic(const collatz_engine& engine, size_t workers_num,
+               const range& range, bool stealing = false);
 
-double block_cyclic(size_t workers_num, size_t chunksize, const range& range);
+/**
+ * @brief computes all the ranges at once: they are fused in a single
+ * iteration space served by one team of workers, created only once, and the
+ * steps are attributed back to each range.
+ */
+double fused(const collatz_engine& engine, size_t workers_num,
+             const std::vector<range>& ranges);
 
-double dynamic(size_t workers_num, const range& range);
+/**
+ * @brief runs the query `q` on `range` with pruning, reporting the result,
+ * the candidates skipped and returning the time. With `check` the brute force
+ * query is run too, outside of the time, and any mismatch is reported.
+ */
+double query(const collatz_engine& engine, collatz_query q,
+             const range& range, bool check = false);
 
 #endif
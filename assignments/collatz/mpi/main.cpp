@@ -0,0 +1,276 @@
+// Collatz steps over MPI ranks with a two-level dynamic load balancing:
+//
+//  - rank 0 owns the fused iteration space of all the ranges and hands out
+//    guided chunks of it on request, merging the results sent back;
+//  - every other rank runs a team of threads that splits each chunk again
+//    through a local chunk_cursor. Two requests are always in flight, so the
+//    next chunk travels while the current one is computed (double buffering).
+//
+// run with: mpirun -n <P> ./collatz_mpi.out <threads> <range1> [ranges...]
+
+#include <mpi.h>
+
+#include <barrier>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "collatz.hpp"
+
+constexpr int REQUEST_TAG = 1; // worker -> master: results of the last chunk
+constexpr int CHUNK_TAG = 2;   // master -> worker: [a, b] global indices
+constexpr int EOS_TAG = 3;     // master -> worker: no more chunks
+
+// every result is sent as (range index, steps, max, argmax)
+constexpr int RECORD = 4;
+
+// smallest chunk sent to a rank and smallest chunk claimed by a thread
+constexpr uint64_t RANK_CHUNK = 1 << 16;
+constexpr uint64_t THREAD_CHUNK = 1024;
+
+#define CHECK_ERROR(err)                                                       \
+    do                                                                         \
+    {                                                                          \
+        if (err != MPI_SUCCESS)                                                \
+        {                                                                      \
+            char errstr[MPI_MAX_ERROR_STRING];                                 \
+            int errlen = 0;                                                    \
+            MPI_Error_string(err, errstr, &errlen);                            \
+            std::fprintf(stderr, "MPI error code %d (%s) line: %d\n", err,     \
+                         std::string(errstr, errlen).c_str(), __LINE__);       \
+            MPI_Abort(MPI_COMM_WORLD, err);                                    \
+            std::abort();                                                      \
+        }                                                                      \
+    } while (0)
+
+// rank 0
+std::vector<collatz_stats> master(const fused_space& space, int size)
+{
+    int error;
+    const int workers = size - 1;
+
+    chunk_cursor cursor;
+    cursor.reset(range(0, space.size() - 1), 4 * workers, RANK_CHUNK);
+
+    std::vector<collatz_stats> results(space.count());
+    std::vector<uint64_t> buffer(RECORD * space.count());
+
+    // every worker opens with two empty requests; the master can leave only
+    // when all of them have been answered and no chunk is still computing
+    int opening = 2 * workers;
+    size_t in_flight = 0;
+    while (opening > 0 || in_flight > 0)
+    {
+        MPI_Status st;
+        error = MPI_Recv(buffer.data(), buffer.size(), MPI_UINT64_T,
+                         MPI_ANY_SOURCE, REQUEST_TAG, MPI_COMM_WORLD, &st);
+        CHECK_ERROR(error);
+
+        int count = 0;
+        MPI_Get_count(&st, MPI_UINT64_T, &count);
+        if (count == 0)
+            opening--;
+        else
+            in_flight--;
+
+        for (int i = 0; i < count; i += RECORD)
+            results[buffer[i]].merge({buffer[i + 1], buffer[i + 2],
+                                      buffer[i + 3]});
+
+        std::optional<range> chunk = cursor.claim();
+        if (chunk.has_value())
+        {
+            uint64_t msg[2] = {chunk->a, chunk->b};
+            error = MPI_Send(msg, 2, MPI_UINT64_T, st.MPI_SOURCE, CHUNK_TAG,
+                             MPI_COMM_WORLD);
+            in_flight++;
+        }
+        else
+            error = MPI_Send(nullptr, 0, MPI_UINT64_T, st.MPI_SOURCE, EOS_TAG,
+                             MPI_COMM_WORLD);
+        CHECK_ERROR(error);
+    }
+
+    return results;
+}
+
+// ranks from 1 to size - 1
+void worker(const collatz_engine& engine, const fused_space& space,
+            size_t threads)
+{
+    int error;
+    const int master = 0;
+
+    // node-level team: the main thread takes part in the computation and is
+    // the only one calling MPI (MPI_THREAD_FUNNELED)
+    chunk_cursor cursor;
+    std::vector<std::vector<collatz_stats>> partials(
+        threads, std::vector<collatz_stats>(space.count()));
+    std::barrier sync(threads);
+    bool stop = false;
+
+    auto work = [&](size_t id) {
+        std::optional<range> chunk;
+        while ((chunk = cursor.claim()).has_value())
+        {
+            space.split(chunk.value(), [&](size_t r, const range& sub) {
+                partials[id][r].merge(engine.stats(sub));
+            });
+        }
+    };
+
+    std::vector<std::thread> team;
+    team.reserve(threads - 1);
+    for (size_t i = 1; i < threads; i++)
+    {
+        team.emplace_back(
+            [&](size_t id) {
+                while (true)
+                {
+                    sync.arrive_and_wait();
+                    if (stop)
+                        return;
+                    work(id);
+                    sync.arrive_and_wait();
+                }
+            },
+            i);
+    }
+
+    // double buffering: two receives posted and two requests sent
+    uint64_t recv_buf[2][2];
+    MPI_Request recv_reqs[2];
+    for (int i = 0; i < 2; i++)
+    {
+        error = MPI_Irecv(recv_buf[i], 2, MPI_UINT64_T, master, MPI_ANY_TAG,
+                          MPI_COMM_WORLD, &recv_reqs[i]);
+        CHECK_ERROR(error);
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        error = MPI_Send(nullptr, 0, MPI_UINT64_T, master, REQUEST_TAG,
+                         MPI_COMM_WORLD);
+        CHECK_ERROR(error);
+    }
+
+    std::vector<uint64_t> records;
+    records.reserve(RECORD * space.count());
+    int outstanding = 2;
+    while (outstanding > 0)
+    {
+        int idx;
+        MPI_Status st;
+        error = MPI_Waitany(2, recv_reqs, &idx, &st);
+        CHECK_ERROR(error);
+        outstanding--;
+
+        // the request is now MPI_REQUEST_NULL and it is ignored by Waitany
+        if (st.MPI_TAG == EOS_TAG)
+            continue;
+
+        range chunk(recv_buf[idx][0], recv_buf[idx][1]);
+        cursor.reset(chunk, 2 * threads, THREAD_CHUNK);
+        for (auto& local : partials)
+            std::fill(local.begin(), local.end(), collatz_stats());
+
+        sync.arrive_and_wait();
+        work(0);
+        sync.arrive_and_wait();
+
+        records.clear();
+        for (size_t r = 0; r < space.count(); r++)
+        {
+            collatz_stats stats;
+            for (const auto& local : partials)
+                stats.merge(local[r]);
+
+            if (stats.argmax == 0)
+                continue;
+
+            records.insert(records.end(),
+                           {r, stats.steps, stats.max, stats.argmax});
+        }
+
+        // repost the receive before asking for the next chunk
+        error = MPI_Irecv(recv_buf[idx], 2, MPI_UINT64_T, master, MPI_ANY_TAG,
+                          MPI_COMM_WORLD, &recv_reqs[idx]);
+        CHECK_ERROR(error);
+        error = MPI_Send(records.data(), records.size(), MPI_UINT64_T, master,
+                         REQUEST_TAG, MPI_COMM_WORLD);
+        CHECK_ERROR(error);
+        outstanding++;
+    }
+
+    stop = true;
+    sync.arrive_and_wait();
+    for (auto& t : team)
+        t.join();
+}
+
+int main(int argc, char* argv[])
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    if (provided < MPI_THREAD_FUNNELED)
+    {
+        std::printf("MPI does not provide required threading support\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+        std::abort();
+    }
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    int threads = argc > 2 ? std::atoi(argv[1]) : 0;
+    if (size < 2 || threads <= 0)
+    {
+        if (rank == 0)
+            std::printf("USAGE: mpirun -n <P >= 2> %s <threads> <range1> "
+                        "[ranges...]\n",
+                        argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    std::vector<range> ranges =
+        parse_ranges(argc, const_cast<const char**>(argv));
+    fused_space space(ranges);
+    if (space.size() == 0)
+    {
+        MPI_Finalize();
+        return 1;
+    }
+
+    // the tables are built before starting the clock
+    const collatz_engine engine;
+
+    MPI_Barrier(MPI_COMM_WORLD); // needed to measure exec time properly
+    double t_start = MPI_Wtime();
+
+    if (rank == 0)
+    {
+        std::vector<collatz_stats> results = master(space, size);
+        double t_end = MPI_Wtime();
+
+        collatz_stats total;
+        for (size_t r = 0; r < space.count(); r++)
+        {
+            total.merge(results[r]);
+            std::printf("%lu-%lu steps: %lu max: %lu (n = %lu)\n", space[r].a,
+                        space[r].b, results[r].steps, results[r].max,
+                        results[r].argmax);
+        }
+        std::printf("total steps: %lu max: %lu (n = %lu)\n", total.steps,
+                    total.max, total.argmax);
+        std::printf("mpi time (%d ranks x %d threads): %.4f s\n", size - 1,
+                    threads, t_end - t_start);
+    }
+    else
+        worker(engine, space, threads);
+
+    MPI_Finalize();
+    return 0;
+}
@@ -1,13 +1,325 @@
+#include <algorithm>
+#include <cassert>
+
 #include "collatz.hpp"
+#include "isa.hpp"
+
+// Continues in 128 bits a trajectory whose next 3n + 1 does not fit 64 bits,
+// until it drops back below 2^64. The steps done are added to `steps` and the
+// highest value, saturated to UINT64_MAX, raises `peak`.
+static uint64_t wide_descent(uint64_t n, uint64_t& steps, uint64_t& peak)
+{
+    unsigned __int128 x = n;
+    do
+    {
+        if (x % 2 == 0)
+            x = x / 2;
+        else
+        {
+            // no known trajectory of a 64 bits value gets close to 2^128
+            bool overflow = __builtin_mul_overflow(x, 3, &x) ||
+                            __builtin_add_overflow(x, 1, &x);
+            assert(!overflow);
+            (void)overflow;
+            peak = UINT64_MAX;
+        }
+        ++steps;
+    } while (x > UINT64_MAX);
+
+    return x;
+}
+
+// one step of the reference path, false if 3n + 1 overflows
+static inline bool collatz_next(uint64_t& n)
+{
+    if (n % 2 == 0)
+    {
+        n = n / 2;
+        return true;
+    }
+
+    return !__builtin_mul_overflow(n, 3, &n) && !__builtin_add_overflow(n, 1, &n);
+}
 
 uint64_t collatz_steps(uint64_t n)
 {
     uint64_t steps = 0;
+    uint64_t peak = 0;
     while (n != 1)
     {
-        n = (n % 2 == 0) ? n / 2 : 3 * n + 1;
-        ++steps;
+        uint64_t x = n;
+        if (collatz_next(x))
+        {
+            n = x;
+            ++steps;
+        }
+        else
+            n = wide_descent(n, steps, peak);
     }
 
     return steps;
 }
+
+uint64_t collatz_peak(uint64_t n)
+{
+    uint64_t steps = 0;
+    uint64_t peak = n;
+    while (n > 1)
+    {
+        uint64_t x = n;
+        if (collatz_next(x))
+            n = x;
+        else
+            n = wide_descent(n, steps, peak);
+        peak = std::max(peak, n);
+    }
+
+    return peak;
+}
+
+collatz_engine::collatz_engine(uint32_t bits, uint64_t cache_bound)
+    : m_bits(bits), m_mask((1UL << bits) - 1), m_jumps(1UL << bits),
+      m_cache(std::max<uint64_t>(cache_bound, 2), 0), m_peaks(m_cache.size()),
+      m_kernel(&collatz_engine::steps_scalar), m_isa("scalar")
+{
+    // 3^bits has to fit the 32 bits multiplier
+    assert(bits >= 1 && bits <= 20);
+
+    // apply `bits` shortcut steps T(x) = x / 2 or (3x + 1) / 2 to the low
+    // bits only: the parity sequence is the same of every n sharing them
+    for (uint64_t b = 0; b <= m_mask; b++)
+    {
+        uint64_t x = b;
+        uint32_t mul = 1;
+        uint32_t odd = 0;
+        for (uint32_t i = 0; i < bits; i++)
+        {
+            if (x % 2 == 0)
+                x = x / 2;
+            else
+            {
+                x = (3 * x + 1) / 2;
+                mul *= 3;
+                odd++;
+            }
+        }
+
+        // every odd shortcut step is a 3n + 1 followed by a halving
+        m_jumps[b] = {mul, bits + odd, x};
+    }
+
+    // any n whose high part does not exceed the smallest (2^64 - 1 - add) / mul
+    // of the table jumps without overflowing the 64 bits
+    uint64_t high = UINT64_MAX;
+    for (const jump& j : m_jumps)
+        high = std::min(high, (UINT64_MAX - j.add) / j.mul);
+    m_jump_bound = (high << bits) | m_mask;
+
+    // every trajectory eventually drops below its starting value, so the
+    // caches can be filled in increasing order
+    m_peaks[1] = 1;
+    for (uint64_t n = 2; n < m_cache.size(); n++)
+    {
+        if (n % 2 == 0)
+        {
+            m_cache[n] = m_cache[n / 2] + 1;
+            m_peaks[n] = std::max(n, m_peaks[n / 2]);
+            continue;
+        }
+
+        uint64_t x = n;
+        uint64_t steps = 0;
+        uint64_t peak = n;
+        while (x >= n)
+        {
+            x = (x % 2 == 0) ? x / 2 : 3 * x + 1;
+            peak = std::max(peak, x);
+            ++steps;
+        }
+        m_cache[n] = m_cache[x] + steps;
+        m_peaks[n] = std::max(peak, m_peaks[x]);
+    }
+
+    // the vector kernels always jump, so every lane must stay above 2^bits
+    if (m_cache.size() <= m_mask)
+        return;
+
+    // the widest kernel the CPU runs, or the one asked with SPM_ISA; the
+    // kernels carry their own target, the rest of the build is generic
+    using kernel_fn =
+        void (collatz_engine::*)(uint64_t, uint64_t, collatz_stats&) const;
+    m_kernel = spm::dispatch<kernel_fn>(&collatz_engine::steps_scalar, nullptr,
+                                        &collatz_engine::steps_avx2,
+                                        &collatz_engine::steps_avx512);
+    if (m_kernel == &collatz_engine::steps_avx512)
+        m_isa = "avx512";
+    else if (m_kernel == &collatz_engine::steps_avx2)
+        m_isa = "avx2";
+}
+
+uint64_t collatz_engine::steps(uint64_t n) const
+{
+    uint64_t steps = 0;
+    while (n >= m_cache.size())
+    {
+        // n >= 2^bits guarantees that the trajectory does not reach 1
+        // before the end of the jump
+        if (n > m_mask)
+        {
+            const jump& j = m_jumps[n & m_mask];
+            uint64_t x;
+            if (__builtin_mul_overflow(n >> m_bits, j.mul, &x) ||
+                __builtin_add_overflow(x, j.add, &x))
+            {
+                // rare: the trajectory leaves the 64 bits for a while
+                uint64_t peak = 0;
+                n = wide_descent(n, steps, peak);
+                continue;
+            }
+
+            n = x;
+            steps += j.steps;
+        }
+        else
+        {
+            n = (n % 2 == 0) ? n / 2 : 3 * n + 1;
+            ++steps;
+        }
+    }
+
+    return steps + m_cache[n];
+}
+
+uint64_t collatz_engine::peak(uint64_t n) const
+{
+    // the jumps skip the intermediate values, so the peak is tracked step by
+    // step until the trajectory reaches the cache
+    uint64_t steps = 0;
+    uint64_t peak = n;
+    while (n >= m_peaks.size())
+    {
+        uint64_t x = n;
+        if (collatz_next(x))
+            n = x;
+        else
+            n = wide_descent(n, steps, peak);
+        peak = std::max(peak, n);
+    }
+
+    return std::max(peak, m_peaks[n]);
+}
+
+query_result collatz_engine::query(collatz_query q, const range& r,
+                                   bool pruning) const
+{
+    query_result best;
+    if (r.a > r.b)
+        return best;
+
+    // values are visited in increasing order, so a tie keeps the smallest
+    auto check = [&](uint64_t n) {
+        uint64_t value = (q == collatz_query::longest) ? steps(n) : peak(n);
+        best.checked++;
+        if (best.argmax == 0 || value > best.value)
+        {
+            best.value = value;
+            best.argmax = n;
+        }
+    };
+
+    if (!pruning)
+    {
+        for (uint64_t n = r.a;; n++)
+        {
+            check(n);
+            if (n == r.b)
+                break;
+        }
+        return best;
+    }
+
+    // an odd n = 6k + 5 is reached in two steps by m = (2n - 1) / 3 = 4k + 3,
+    // as 3m + 1 = 2n: m is smaller, has two more steps and a peak at least as
+    // high, so n is beaten whenever m belongs to the range
+    auto shadowed = [&](uint64_t n) {
+        return n % 6 == 5 && (2 * n - 1) / 3 >= r.a;
+    };
+
+    if (q == collatz_query::longest)
+    {
+        // steps(2n) = steps(n) + 1: every n <= b / 2 is beaten by 2n
+        range upper(std::max(r.a, r.b / 2 + 1), r.b);
+
+        // the lanes are refilled with consecutive values and cannot skip the
+        // shadowed ones, yet they beat the scalar loop that does
+        if (m_kernel != &collatz_engine::steps_scalar)
+        {
+            collatz_stats stats = this->stats(upper);
+            best.value = stats.max;
+            best.argmax = stats.argmax;
+            best.checked = upper.length();
+            return best;
+        }
+
+        for (uint64_t n = upper.a;; n++)
+        {
+            if (!shadowed(n))
+                check(n);
+            if (n == upper.b)
+                break;
+        }
+
+        return best;
+    }
+
+    // peak(n) = max(n, peak(n / 2)) for an even n: if n / 2 is in the range
+    // only n itself can be new, but n <= b < 3o + 1 <= peak(o) for the
+    // largest odd o > 1 of the range, which must then exist
+    uint64_t odd = (r.b % 2 == 1) ? r.b : r.b - 1;
+    bool halving = odd >= r.a && odd > 1;
+    for (uint64_t n = r.a;; n++)
+    {
+        bool halved = halving && n % 2 == 0 && n / 2 >= r.a;
+        if (!halved && !shadowed(n))
+            check(n);
+        if (n == r.b)
+            break;
+    }
+
+    return best;
+}
+
+void collatz_engine::steps_scalar(uint64_t a, uint64_t b,
+                                  collatz_stats& stats) const
+{
+    if (a > b)
+        return;
+
+    // `i <= b` would always hold for b == UINT64_MAX
+    for (uint64_t i = a;; i++)
+    {
+        stats.add(i, steps(i));
+        if (i == b)
+            break;
+    }
+}
+
+bool collatz_engine::next_lane(uint64_t& next, uint64_t b,
+                               collatz_stats& stats) const
+{
+    for (; next <= b && next < m_cache.size(); next++)
+        stats.add(next, m_cache[next]);
+
+    return next <= b;
+}
+
+void collatz_engine::finish_lanes(uint32_t mask, const uint64_t* n,
+                                  const uint64_t* s, const uint64_t* start,
+                                  collatz_stats& stats) const
+{
+    for (; mask != 0; mask &= mask - 1)
+    {
+        int l = __builtin_ctz(mask);
+        stats.add(start[l], s[l] + steps(n[l]));
+    }
+}
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
@@ -5,14 +6,64 @@
 #include <vector>
 
 #include "collatz.hpp"
-#include "mpmc_queue.hpp"
 #include "timer.hpp"
 
-double dynamic(size_t workers_num, const range& range)
+// smallest chunk handed to the vector kernel
+constexpr uint64_t smallest_chunk = 1024;
+
+void chunk_cursor::reset(const range& r, uint64_t divisor, uint64_t min_chunk)
+{
+    m_left.store(r.length(), std::memory_order_relaxed);
+    m_end = r.b;
+    m_divisor = std::max<uint64_t>(divisor, 1);
+    m_min_chunk = std::max<uint64_t>(min_chunk, 1);
+}
+
+std::optional<range> chunk_cursor::claim()
+{
+    uint64_t remaining = m_left.load(std::memory_order_relaxed);
+    while (remaining > 0)
+    {
+        uint64_t size =
+            std::min(remaining, std::max(m_min_chunk, remaining / m_divisor));
+
+        // on failure `remaining` is reloaded with the current value
+        if (m_left.compare_exchange_weak(remaining, remaining - size,
+                                         std::memory_order_relaxed))
+        {
+            uint64_t next = m_end - (remaining - 1);
+            return range(next, next + (size - 1));
+        }
+    }
+
+    return std::nullopt;
+}
+
+double dynamic(const collatz_engine& engine, size_t workers_num,
+               const range& range, bool stealing)
 {
     std::vector<std::thread> workers;
     workers.reserve(workers_num);
-    spm::mpmc_queue<uint64_t> buffer(range.length() * 2);
+
+    // without stealing all the workers share a single cursor, otherwise every
+    // worker owns a block of the range and steals from the others when done
+    std::vector<chunk_cursor> cursors(stealing ? workers_num : 1);
+    if (!stealing)
+        cursors[0].reset(range, 2 * workers_num, smallest_chunk);
+    else
+    {
+        uint64_t block = range.length() / workers_num;
+        uint64_t extra = range.length() % workers_num;
+        uint64_t a = range.a;
+        for (size_t i = 0; i < workers_num; i++)
+        {
+            // an empty block is left empty even if `a` wrapped to 0
+            uint64_t len = block + (i < extra ? 1 : 0);
+            if (len > 0)
+                cursors[i].reset(::range(a, a + (len - 1)), 2, smallest_chunk);
+            a += len;
+        }
+    }
 
     std::atomic<uint64_t> counter(0);
 
@@ -23,14 +74,14 @@ double dynamic(size_t workers_num, const range& range)
         workers.emplace_back(
             [&](size_t id) {
                 uint64_t local_counter = 0;
-                std::optional<uint64_t> value;
-                while (true)
+                std::optional<::range> chunk;
+
+                // a drained cursor is never refilled, so one pass is enough
+                for (size_t k = 0; k < cursors.size(); k++)
                 {
-                    value = buffer.pop();
-                    if (!value.has_value())
-                        break;
-                    else
-                        local_counter += collatz_steps(value.value());
+                    chunk_cursor& cursor = cursors[(id + k) % cursors.size()];
+                    while ((chunk = cursor.claim()).has_value())
+                        local_counter += engine.steps(chunk.value());
                 }
 
                 counter.fetch_add(local_counter);
@@ -38,16 +89,12 @@ double dynamic(size_t workers_num, const range& range)
             i);
     }
 
-    for (uint64_t i = range.a; i <= range.b; i++)
-        buffer.push(i);
-
-    buffer.close();
-
     for (auto& w : workers)
         w.join();
     double time = timer.stop();
 
-    std::printf("dynamic steps: %lu\n", counter.load());
+    std::printf("dynamic%s steps: %lu\n", stealing ? " (stealing)" : "",
+                counter.load());
 
     return time;
 }
@@ -0,0 +1,63 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "collatz.hpp"
+#include "timer.hpp"
+
+double fused(const collatz_engine& engine, size_t workers_num,
+             const std::vector<range>& ranges)
+{
+    fused_space space(ranges);
+    if (space.size() == 0)
+        return 0.0;
+
+    chunk_cursor cursor;
+    cursor.reset(range(0, space.size() - 1), 2 * workers_num, 1024);
+
+    // per worker steps of every range, merged after the join
+    std::vector<std::vector<uint64_t>> partials(
+        workers_num, std::vector<uint64_t>(space.count(), 0));
+
+    std::vector<std::thread> workers;
+    workers.reserve(workers_num);
+
+    spm::timer timer;
+    timer.start();
+    for (size_t i = 0; i < workers_num; i++)
+    {
+        workers.emplace_back(
+            [&](size_t id) {
+                std::vector<uint64_t>& local = partials[id];
+                std::optional<range> chunk;
+                while ((chunk = cursor.claim()).has_value())
+                {
+                    space.split(chunk.value(), [&](size_t r, const range& sub) {
+                        local[r] += engine.steps(sub);
+                    });
+                }
+            },
+            i);
+    }
+
+    for (auto& w : workers)
+        w.join();
+    double time = timer.stop();
+
+    uint64_t total = 0;
+    for (size_t r = 0; r < space.count(); r++)
+    {
+        uint64_t steps = 0;
+        for (const auto& local : partials)
+            steps += local[r];
+
+        total += steps;
+        std::printf("fused %lu-%lu steps: %lu\n", space[r].a, space[r].b,
+                    steps);
+    }
+    std::printf("fused total steps: %lu\n", total);
+
+    return time;
+}
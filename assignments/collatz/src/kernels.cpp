@@ -0,0 +1,273 @@
+// GCC 12 warns on the self-initialized undefined vectors used inside the
+// AVX-512 intrinsics headers (PR 105593)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+
+#include "collatz.hpp"
+
+// Every lane runs the same jump of the scalar engine: the (mul, steps) and add
+// words of the table entry are gathered, the 64 x 32 bits product is split in
+// two 32 x 32 bits multiplications. A lane whose trajectory drops below the
+// cache bound is retired and refilled with the next value of the range, so is
+// a lane whose jump could overflow the 64 bits, after finishing its trajectory
+// on the overflow-safe scalar path. The cursor `next` never moves past b, as
+// a range may end at UINT64_MAX: a lane is in range when its offset from next
+// is at most b - next, and the range is exhausted once more values than that
+// have been handed out.
+
+// prefix position of every lane among the ones set in a 4 bits mask, the AVX2
+// replacement of the AVX-512 expand
+alignas(32) static const int64_t expand4[16][4] = {
+    {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 1, 0, 0},
+    {0, 0, 0, 0}, {0, 0, 1, 0}, {0, 0, 1, 0}, {0, 1, 2, 0},
+    {0, 0, 0, 0}, {0, 0, 0, 1}, {0, 0, 0, 1}, {0, 1, 0, 2},
+    {0, 0, 0, 1}, {0, 0, 1, 2}, {0, 0, 1, 2}, {0, 1, 2, 3}};
+
+// moves the cursor `next` by `count` values, or marks the range exhausted if
+// that would go past b
+static inline void advance(uint64_t& next, uint64_t b, uint64_t count,
+                           bool& exhausted)
+{
+    if (count > b - next)
+        exhausted = true;
+    else
+        next += count;
+}
+
+// the lanes whose offset from `next` is at most b - next. The helpers carry
+// the target of their kernel, which a lambda would not inherit; the offsets
+// are small, so the signed comparison of AVX2 is enough
+__attribute__((target("avx2"))) static inline __m256i
+in_range_avx2(__m256i voffset, uint64_t next, uint64_t b, bool exhausted)
+{
+    int64_t last = exhausted ? -1 : int64_t(std::min<uint64_t>(b - next, 4));
+    return _mm256_andnot_si256(
+        _mm256_cmpgt_epi64(voffset, _mm256_set1_epi64x(last)),
+        _mm256_set1_epi64x(-1));
+}
+
+__attribute__((target("avx512f"))) static inline __mmask8
+in_range_avx512(__mmask8 mask, __m512i voffset, uint64_t next, uint64_t b,
+                bool exhausted)
+{
+    if (exhausted)
+        return 0;
+    return _mm512_mask_cmple_epu64_mask(
+        mask, voffset, _mm512_set1_epi64(std::min<uint64_t>(b - next, 8)));
+}
+
+__attribute__((target("avx2"))) void
+collatz_engine::steps_avx2(uint64_t a, uint64_t b, collatz_stats& stats) const
+{
+    static_assert(sizeof(jump) == 2 * sizeof(uint64_t));
+    constexpr uint64_t lanes = 4;
+
+    uint64_t next = a;
+    if (!next_lane(next, b, stats))
+        return;
+
+    const long long* table = reinterpret_cast<const long long*>(m_jumps.data());
+    const int* cache = reinterpret_cast<const int*>(m_cache.data() - 1);
+    const __m256i vmask = _mm256_set1_epi64x(m_mask);
+    const __m256i vlow = _mm256_set1_epi64x(0xffffffff);
+    const __m256i vone = _mm256_set1_epi64x(1);
+    const __m256i vsign = _mm256_set1_epi64x(INT64_MIN);
+    const __m256i vbound =
+        _mm256_xor_si256(_mm256_set1_epi64x(m_cache.size()), vsign);
+    const __m256i vsafe =
+        _mm256_xor_si256(_mm256_set1_epi64x(m_jump_bound), vsign);
+    const __m256i viota = _mm256_set_epi64x(3, 2, 1, 0);
+    const __m128i vbits = _mm_cvtsi32_si128(m_bits);
+
+    // AVX2 has only signed comparisons: every operand of a comparison against
+    // the bounds is flipped in the sign bit
+    bool exhausted = false;
+
+    // from here on every value is above the cache bound, so lanes are refilled
+    // in-register with consecutive values
+    __m256i vn = _mm256_add_epi64(_mm256_set1_epi64x(next), viota);
+    __m256i vstart = vn;
+    __m256i vs = _mm256_setzero_si256();
+    __m256i vtotal = _mm256_setzero_si256();
+    __m256i vmax = _mm256_setzero_si256();
+    __m256i vargmax = _mm256_setzero_si256();
+    __m256i vactive = in_range_avx2(viota, next, b, exhausted);
+    advance(next, b, lanes, exhausted);
+
+    while (!_mm256_testz_si256(vactive, vactive))
+    {
+        __m256i vwide = _mm256_and_si256(
+            vactive, _mm256_cmpgt_epi64(_mm256_xor_si256(vn, vsign), vsafe));
+        int wide = _mm256_movemask_pd(_mm256_castsi256_pd(vwide));
+        if (wide != 0)
+        {
+            alignas(32) uint64_t n[lanes], s[lanes], start[lanes];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(n), vn);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(s), vs);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(start), vstart);
+            finish_lanes(wide, n, s, start, stats);
+            vactive = _mm256_andnot_si256(vwide, vactive);
+        }
+
+        __m256i idx = _mm256_slli_epi64(_mm256_and_si256(vn, vmask), 1);
+        __m256i lo = _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), table,
+                                                 idx, vactive, 8);
+        __m256i add = _mm256_mask_i64gather_epi64(
+            _mm256_setzero_si256(), table, _mm256_add_epi64(idx, vone),
+            vactive, 8);
+
+        __m256i hi = _mm256_srl_epi64(vn, vbits);
+        __m256i mul = _mm256_and_si256(lo, vlow);
+        __m256i prod = _mm256_add_epi64(
+            _mm256_mul_epu32(hi, mul),
+            _mm256_slli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(hi, 32), mul),
+                              32));
+
+        vn = _mm256_add_epi64(prod, add);
+        vs = _mm256_add_epi64(vs, _mm256_srli_epi64(lo, 32));
+
+        __m256i vdone = _mm256_and_si256(
+            vactive, _mm256_cmpgt_epi64(vbound, _mm256_xor_si256(vn, vsign)));
+        int done = _mm256_movemask_pd(_mm256_castsi256_pd(vdone));
+        if ((done | wide) == 0)
+            continue;
+
+        // retire the lanes: add the steps done so far and the cached ones,
+        // gathering the 32 bits word (cache[n - 1], cache[n]). The other
+        // lanes read cache[0] to stay in bounds
+        __m256i cidx = _mm256_blendv_epi8(vone, vn, vdone);
+        __m256i cached = _mm256_cvtepu32_epi64(
+            _mm_srli_epi32(_mm256_i64gather_epi32(cache, cidx, 2), 16));
+        __m256i value = _mm256_and_si256(vdone, _mm256_add_epi64(vs, cached));
+        vtotal = _mm256_add_epi64(vtotal, value);
+
+        // the starting values of a lane grow, so a tie keeps the older one
+        __m256i longer = _mm256_cmpgt_epi64(value, vmax);
+        vmax = _mm256_blendv_epi8(vmax, value, longer);
+        vargmax = _mm256_blendv_epi8(vargmax, vstart, longer);
+
+        // refill them, and the wide ones, with the next values of the range
+        int refill = done | wide;
+        __m256i vrefill = _mm256_or_si256(vdone, vwide);
+        __m256i voffset = _mm256_load_si256(
+            reinterpret_cast<const __m256i*>(expand4[refill]));
+        __m256i vnext = _mm256_add_epi64(_mm256_set1_epi64x(next), voffset);
+        vn = _mm256_blendv_epi8(vn, vnext, vrefill);
+        vstart = _mm256_blendv_epi8(vstart, vn, vrefill);
+        vs = _mm256_andnot_si256(vrefill, vs);
+        __m256i vin = in_range_avx2(voffset, next, b, exhausted);
+        vactive = _mm256_or_si256(_mm256_andnot_si256(vrefill, vactive),
+                                  _mm256_and_si256(vrefill, vin));
+        advance(next, b, __builtin_popcount(refill), exhausted);
+    }
+
+    alignas(32) uint64_t total[lanes], max[lanes], argmax[lanes];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(total), vtotal);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(max), vmax);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(argmax), vargmax);
+    for (uint64_t l = 0; l < lanes; l++)
+        stats.merge({total[l], max[l], argmax[l]});
+}
+
+__attribute__((target("avx512f"))) void
+collatz_engine::steps_avx512(uint64_t a, uint64_t b,
+                             collatz_stats& stats) const
+{
+    static_assert(sizeof(jump) == 2 * sizeof(uint64_t));
+    constexpr uint64_t lanes = 8;
+
+    uint64_t next = a;
+    if (!next_lane(next, b, stats))
+        return;
+
+    const void* table = m_jumps.data();
+    const __m512i vmask = _mm512_set1_epi64(m_mask);
+    const __m512i vlow = _mm512_set1_epi64(0xffffffff);
+    const __m512i vone = _mm512_set1_epi64(1);
+    const __m512i vbound = _mm512_set1_epi64(m_cache.size());
+    const __m512i vsafe = _mm512_set1_epi64(m_jump_bound);
+    const __m512i viota = _mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0);
+    const __m128i vbits = _mm_cvtsi32_si128(m_bits);
+
+    bool exhausted = false;
+
+    // from here on every value is above the cache bound, so lanes are refilled
+    // in-register with consecutive values
+    __m512i vn = _mm512_add_epi64(_mm512_set1_epi64(next), viota);
+    __m512i vstart = vn;
+    __m512i vs = _mm512_setzero_si512();
+    __m512i vtotal = _mm512_setzero_si512();
+    __m512i vmax = _mm512_setzero_si512();
+    __m512i vargmax = _mm512_setzero_si512();
+    __mmask8 active = in_range_avx512(0xff, viota, next, b, exhausted);
+    advance(next, b, lanes, exhausted);
+
+    while (active != 0)
+    {
+        __mmask8 wide = _mm512_mask_cmpgt_epu64_mask(active, vn, vsafe);
+        if (wide != 0)
+        {
+            alignas(64) uint64_t n[lanes], s[lanes], start[lanes];
+            _mm512_store_si512(n, vn);
+            _mm512_store_si512(s, vs);
+            _mm512_store_si512(start, vstart);
+            finish_lanes(wide, n, s, start, stats);
+            active &= ~wide;
+        }
+
+        __m512i idx = _mm512_slli_epi64(_mm512_and_si512(vn, vmask), 1);
+        __m512i lo = _mm512_mask_i64gather_epi64(_mm512_setzero_si512(),
+                                                 active, idx, table, 8);
+        __m512i add = _mm512_mask_i64gather_epi64(
+            _mm512_setzero_si512(), active, _mm512_add_epi64(idx, vone), table,
+            8);
+
+        __m512i hi = _mm512_srl_epi64(vn, vbits);
+        __m512i mul = _mm512_and_si512(lo, vlow);
+        __m512i prod = _mm512_add_epi64(
+            _mm512_mul_epu32(hi, mul),
+            _mm512_slli_epi64(_mm512_mul_epu32(_mm512_srli_epi64(hi, 32), mul),
+                              32));
+
+        vn = _mm512_add_epi64(prod, add);
+        vs = _mm512_add_epi64(vs, _mm512_srli_epi64(lo, 32));
+
+        __mmask8 done = _mm512_mask_cmplt_epu64_mask(active, vn, vbound);
+        if ((done | wide) == 0)
+            continue;
+
+        // retire the lanes: add the steps done so far and the cached ones,
+        // gathering the 32 bits word (cache[n - 1], cache[n]) to never read
+        // past the end of the cache
+        __m256i cached = _mm512_mask_i64gather_epi32(
+            _mm256_setzero_si256(), done, vn, m_cache.data() - 1, 2);
+        cached = _mm256_srli_epi32(cached, 16);
+        __m512i value = _mm512_add_epi64(vs, _mm512_cvtepu32_epi64(cached));
+        vtotal = _mm512_mask_add_epi64(vtotal, done, vtotal, value);
+
+        // the starting values of a lane grow, so a tie keeps the older one
+        __mmask8 longer = _mm512_mask_cmpgt_epu64_mask(done, value, vmax);
+        vmax = _mm512_mask_mov_epi64(vmax, longer, value);
+        vargmax = _mm512_mask_mov_epi64(vargmax, longer, vstart);
+
+        // refill them, and the wide ones, with the next values of the range
+        __mmask8 refill = done | wide;
+        __m512i voffset = _mm512_maskz_expand_epi64(refill, viota);
+        vn = _mm512_mask_add_epi64(vn, refill, _mm512_set1_epi64(next),
+                                   voffset);
+        vstart = _mm512_mask_mov_epi64(vstart, refill, vn);
+        vs = _mm512_mask_mov_epi64(vs, refill, _mm512_setzero_si512());
+        active = (active & ~refill) |
+                 in_range_avx512(refill, voffset, next, b, exhausted);
+        advance(next, b, __builtin_popcount(refill), exhausted);
+    }
+
+    alignas(64) uint64_t total[lanes], max[lanes], argmax[lanes];
+    _mm512_store_si512(total, vtotal);
+    _mm512_store_si512(max, vmax);
+    _mm512_store_si512(argmax, vargmax);
+    for (uint64_t l = 0; l < lanes; l++)
+        stats.merge({total[l], max[l], argmax[l]});
+}
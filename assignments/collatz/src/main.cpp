@@ -1,40 +1,24 @@
 #include <cmath>
+#include <cstdio>
 #include <regex>
 
 #include "collatz.hpp"
 
-std::vector<range> parse_ranges(int argc, const char** argv)
+int main(int argc, const char** argv)
 {
-    std::vector<range> ranges;
-    std::regex regex(R"(^(\d+)-(\d+)$)");
-    std::smatch match;
-
-    for (int i = 2; i < argc; i++)
+    // -c checks the pruned queries against the brute force ones
+    bool check = argc > 1 && std::string(argv[1]) == "-c";
+    if (check)
     {
-        std::string arg(argv[i]);
-        if (std::regex_match(arg, match, regex))
-        {
-            uint64_t start = std::stoull(match[1]);
-            uint64_t end = std::stoull(match[2]);
-            if (start <= 0 || end <= 0)
-                std::printf("%s: ranges have to be > 0\n", arg.c_str());
-            else if (start >= end)
-                std::printf("%s: range start >= than range end\n", arg.c_str());
-            else
-                ranges.emplace_back(start, end);
-        }
-        else
-            std::printf("%s: bad format\n", arg.c_str());
+        argv[1] = argv[0];
+        argv++;
+        argc--;
     }
 
-    return ranges;
-}
-
-int main(int argc, const char** argv)
-{
     if (argc <= 2)
     {
-        std::printf("USAGE: %s <workers> <range1> [ranges...]\n", argv[0]);
+        std::printf("USAGE: %s [-c] <workers> <range1> [ranges...]\n",
+                    argv[0]);
         return 1;
     }
 
@@ -47,45 +31,73 @@ int main(int argc, const char** argv)
         p = std::atoi(argv[1]);
     else
     {
-        std::printf("USAGE: %s <workers> <range1> [ranges...]\n", argv[0]);
+        std::printf("USAGE: %s [-c] <workers> <range1> [ranges...]\n",
+                    argv[0]);
         return 1;
     }
 
     std::vector<range> ranges = parse_ranges(argc, argv);
 
+    // jump and cache tables shared by every policy
+    const collatz_engine engine;
+    std::printf("kernel: %s\n\n", engine.isa());
+
     // sequential
     double stime = 0.0;
     for (const auto& r : ranges)
-        stime += sequential(r);
+        stime += sequential(engine, r);
     std::printf("sequential time: %.4f s\n\n", stime);
 
     // block
     double btime = 0.0;
     for (const auto& r : ranges)
-        btime += block_cyclic(p, std::ceil(r.length() / p), r);
+        btime += block_cyclic(engine, p, std::ceil(r.length() / p), r);
     std::printf("block time: %.4f s\n", btime);
     std::printf("block speedup: %.2f\n\n", (stime / btime));
 
     // cyclic time
     double ctime = 0.0;
     for (const auto& r : ranges)
-        ctime += block_cyclic(p, 1, r);
+        ctime += block_cyclic(engine, p, 1, r);
     std::printf("cyclic time: %.4f s\n", ctime);
     std::printf("cyclic speedup: %.2f\n\n", (stime / ctime));
 
     // block-cyclic time
     double bctime = 0.0;
     for (const auto& r : ranges)
-        bctime += block_cyclic(p, std::ceil(std::ceil(r.length() / p) / 4), r);
+        bctime += block_cyclic(engine, p,
+                               std::ceil(std::ceil(r.length() / p) / 4), r);
     std::printf("block-cyclic time: %.4f s\n", bctime);
     std::printf("block-cyclic speedup: %.2f\n\n", (stime / bctime));
 
     // dynamic
     double dtime = 0.0;
     for (const auto& r : ranges)
-        dtime += dynamic(p, r);
+        dtime += dynamic(engine, p, r);
     std::printf("dynamic time: %.4f s\n", dtime);
-    std::printf("dynamic speedup: %.2f\n", (stime / dtime));
+    std::printf("dynamic speedup: %.2f\n\n", (stime / dtime));
+
+    // dynamic with work stealing
+    double wtime = 0.0;
+    for (const auto& r : ranges)
+        wtime += dynamic(engine, p, r, true);
+    std::printf("stealing time: %.4f s\n", wtime);
+    std::printf("stealing speedup: %.2f\n\n", (stime / wtime));
+
+    // all the ranges fused and served by a single team of workers
+    double ftime = fused(engine, p, ranges);
+    std::printf("fused time: %.4f s\n", ftime);
+    std::printf("fused speedup: %.2f\n\n", (stime / ftime));
+
+    // longest trajectory and highest peak of every range
+    for (auto q : {collatz_query::longest, collatz_query::peak})
+    {
+        double qtime = 0.0;
+        for (const auto& r : ranges)
+            qtime += query(engine, q, r, check);
+        std::printf("%s time: %.4f s\n\n",
+                    q == collatz_query::longest ? "longest" : "peak", qtime);
+    }
 
     return 0;
 }
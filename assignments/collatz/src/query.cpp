@@ -0,0 +1,35 @@
+#include <cstdio>
+
+#include "collatz.hpp"
+#include "timer.hpp"
+
+double query(const collatz_engine& engine, collatz_query q,
+             const range& range, bool check)
+{
+    const char* name = (q == collatz_query::longest) ? "longest" : "peak";
+
+    spm::timer timer;
+    timer.start();
+    query_result pruned = engine.query(q, range);
+    double time = timer.stop();
+
+    std::printf("%s %lu-%lu: %lu (n = %lu)\n", name, range.a, range.b,
+                pruned.value, pruned.argmax);
+    std::printf("%s checked: %lu of %lu (%.1f%% pruned)\n", name,
+                pruned.checked, range.length(),
+                100.0 * (range.length() - pruned.checked) / range.length());
+
+    if (!check)
+        return time;
+
+    // the brute force path is the reference of the pruned one
+    timer.start();
+    query_result brute = engine.query(q, range, false);
+    double brute_time = timer.stop();
+    if (pruned.value != brute.value || pruned.argmax != brute.argmax)
+        std::printf("%s MISMATCH brute force: %lu (n = %lu)\n", name,
+                    brute.value, brute.argmax);
+    std::printf("%s brute force time: %.4f s\n", name, brute_time);
+
+    return time;
+}
@@ -0,0 +1,39 @@
+#include <cstdio>
+#include <regex>
+#include <string>
+
+#include "collatz.hpp"
+
+std::vector<range> parse_ranges(int argc, const char** argv)
+{
+    std::vector<range> ranges;
+    std::regex regex(R"(^(\d+)-(\d+)$)");
+    std::smatch match;
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        if (std::regex_match(arg, match, regex))
+        {
+            uint64_t start = std::stoull(match[1]);
+            uint64_t end = std::stoull(match[2]);
+            if (start <= 0 || end <= 0)
+                std::printf("%s: ranges have to be > 0\n", arg.c_str());
+            else if (start >= end)
+                std::printf("%s: range start >= than range end\n", arg.c_str());
+            else
+                ranges.emplace_back(start, end);
+        }
+        else
+            std::printf("%s: bad format\n", arg.c_str());
+    }
+
+    return ranges;
+}
+
+fused_space::fused_space(const std::vector<range>& ranges)
+    : m_ranges(ranges), m_offsets(ranges.size() + 1, 0)
+{
+    for (size_t r = 0; r < ranges.size(); r++)
+        m_offsets[r + 1] = m_offsets[r] + ranges[r].length();
+}
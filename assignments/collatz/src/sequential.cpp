@@ -1,15 +1,18 @@
+#include <cstdio>
+
 #include "collatz.hpp"
 
 #include "timer.hpp"
 
-double sequential(const range& range)
+double sequential(const collatz_engine& engine, const range& range)
 {
     uint64_t counter = 0;
     spm::timer timer;
     timer.start();
-    for (uint64_t i = range.a; i <= range.b; i++)
-        counter += collatz_steps(i);
+    counter += engine.steps(range);
     double time = timer.stop();
 
+    std::printf("sequential steps: %lu\n", counter);
+
     return time;
 }
@@ -1,11 +1,14 @@
+#include <algorithm>
 #include <atomic>
+#include <cstdio>
 #include <thread>
 #include <vector>
 
 #include "collatz.hpp"
 #include "timer.hpp"
 
-double block_cyclic(size_t workers_num, size_t chunksize, const range& range)
+double block_cyclic(const collatz_engine& engine, size_t workers_num,
+                    size_t chunksize, const range& range)
 {
     // pool of workers
     std::vector<std::thread> workers;
@@ -14,6 +17,9 @@ double block_cyclic(size_t workers_num, size_t chunksize, const range& range)
     // global steps counter
     std::atomic<uint64_t> counter(0);
 
+    // a range shorter than the workers asks for chunks of 0 values
+    chunksize = std::max<size_t>(chunksize, 1);
+
     spm::timer timer;
     timer.start();
     for (size_t w = 0; w < workers_num; w++)
@@ -21,15 +27,19 @@ double block_cyclic(size_t workers_num, size_t chunksize, const range& range)
         workers.emplace_back(
             [&](size_t id) {
                 uint64_t local_counter = 0;
-                for (uint64_t i = range.a + id * chunksize; i <= range.b;
-                     i += workers_num * chunksize)
+                const uint64_t stride = workers_num * chunksize;
+                if (range.a > range.b || id * chunksize > range.b - range.a)
+                    return;
+
+                // the distances to range.b are compared before moving, so
+                // that a range ending at UINT64_MAX does not wrap i to 0
+                for (uint64_t i = range.a + id * chunksize;; i += stride)
                 {
-                    for (uint64_t j = i;
-                         j < std::min(i + chunksize, range.b + 1); j++)
-                    {
-                        // std::printf("thread %zu compute on %lu\n", id, j);
-                        local_counter += collatz_steps(j);
-                    }
+                    // the whole chunk goes through the vector kernel
+                    ::range chunk(i, i + std::min(chunksize - 1, range.b - i));
+                    local_counter += engine.steps(chunk);
+                    if (range.b - i < stride)
+                        break;
                 }
 
                 counter.fetch_add(local_counter);
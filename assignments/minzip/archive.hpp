@@ -0,0 +1,810 @@
+#if !defined _ARCHIVE_HPP
+#define _ARCHIVE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <sys/uio.h>
+#include <vector>
+
+#include <omp.h>
+
+#include <config.hpp>
+#include <container.hpp>
+#include <dict.hpp>
+#include <level.hpp>
+#include <utility.hpp>
+
+// minzip archive: all the files of a directory in a single file, written by
+// minizpar -a 1 (solid archive) or -d (shared dictionary)
+//
+//   ArchiveHeader | MemberEntry[nmembers] | BlockEntry[nblocks] | names |
+//   dictionary | block 0 | block 1 | ...
+//
+// The members (the files of the directory) are concatenated one after the
+// other in a single stream, and every member has its name, starting with
+// the name of the directory, its offset in the stream, its size and its
+// permissions. The stream is split into blocks like the file of a
+// container, with the same block table: in a solid archive every BLOCK_SIZE
+// bytes, so that the small files share their blocks, with -d alone at the
+// members' boundaries too, so that every small file is a block of its own
+// compressed against the dictionary. The dictionary is stored once: with it
+// every block not stored as it is is a raw deflate stream that continues
+// the dictionary (see dict.hpp), without it (dictSize 0) a zlib stream. The
+// header has the CRC32 of everything between itself and the blocks. The
+// archive of the directory dir is dir + SUFFIX, and it is extracted next to
+// itself, all of it or only the members selected with -m.
+
+constexpr char ARCHIVE_MAGIC[4] = {'M', 'Z', 'P', 'A'};
+constexpr uint32_t ARCHIVE_VERSION = 2;
+
+struct ArchiveHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t blockSize; // bytes of input per block
+    uint64_t size;      // of the stream of all the members
+    uint64_t nmembers;
+    uint64_t nblocks;
+    uint64_t namesSize; // the names one after the other, not terminated
+    uint32_t dictSize;  // bytes of the dictionary, 0 is none
+    uint32_t tableCrc;  // CRC32 of the tables, the names and the dictionary
+};
+
+struct MemberEntry
+{
+    uint64_t nameOffset; // from the beginning of the names
+    uint64_t nameSize;
+    uint64_t offset; // in the stream of all the members
+    uint64_t size;   // of the original file
+    uint32_t mode;   // permission bits
+    uint32_t reserved;
+};
+
+// a file to put in an archive
+struct ArchiveFile
+{
+    std::string path; // to open it
+    std::string name; // in the archive
+    size_t size;
+    uint32_t mode;
+};
+
+// true if the data pointed by 'ptr' starts with an archive header
+static inline bool isArchive(const unsigned char* ptr, size_t size)
+{
+    return size >= sizeof(ArchiveHeader) &&
+           std::memcmp(ptr, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0;
+}
+
+// true if the member name stays below the directory it is extracted into:
+// relative, and with no empty, "." or ".." components
+static inline bool isSafeName(const std::string& name)
+{
+    if (name.empty() || name.find('\0') != std::string::npos)
+        return false;
+    size_t start = 0;
+    while (start <= name.size())
+    {
+        size_t end = std::min(name.find('/', start), name.size());
+        std::string c = name.substr(start, end - start);
+        if (c.empty() || c == "." || c == "..")
+            return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+// it checks the header, the tables and the names of the archive pointed by
+// 'ptr' and having size 'size', without inflating the blocks. If everything
+// is ok, hdr is the header and the pointers point to the parts of the archive
+static inline bool checkArchive(const unsigned char* ptr, size_t size,
+                                const std::string& fname, ArchiveHeader& hdr,
+                                const MemberEntry*& members,
+                                const BlockEntry*& table, const char*& names,
+                                const unsigned char*& dict)
+{
+    auto fail = [&](const char* what) {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "%s: %s\n", fname.c_str(), what);
+        return false;
+    };
+    if (!isArchive(ptr, size))
+        return fail("not a minzip archive");
+    std::memcpy(&hdr, ptr, sizeof(hdr));
+    if (hdr.version != ARCHIVE_VERSION)
+        return fail("unsupported archive version");
+    if (hdr.dictSize > DICT_MAX)
+        return fail("inconsistent archive header");
+
+    // every part fits in the file, then all of them together
+    const size_t left = size - sizeof(hdr);
+    if (hdr.nmembers > left / sizeof(MemberEntry) ||
+        hdr.nblocks > left / sizeof(BlockEntry) || hdr.namesSize > left)
+        return fail("truncated archive tables");
+    const uint64_t metaSize = hdr.nmembers * sizeof(MemberEntry) +
+                              hdr.nblocks * sizeof(BlockEntry) +
+                              hdr.namesSize + hdr.dictSize;
+    if (metaSize > left)
+        return fail("truncated archive tables");
+    if (crc32(MZ_CRC32_INIT, ptr + sizeof(hdr), metaSize) != hdr.tableCrc)
+        return fail("corrupted archive tables");
+
+    members = reinterpret_cast<const MemberEntry*>(ptr + sizeof(hdr));
+    table = reinterpret_cast<const BlockEntry*>(members + hdr.nmembers);
+    names = reinterpret_cast<const char*>(table + hdr.nblocks);
+    dict = reinterpret_cast<const unsigned char*>(names + hdr.namesSize);
+
+    // the members follow one another in the stream, and so do the blocks
+    uint64_t end = 0;
+    for (size_t i = 0; i < hdr.nmembers; i++)
+    {
+        const MemberEntry& m = members[i];
+        if (m.nameOffset > hdr.namesSize ||
+            m.nameSize > hdr.namesSize - m.nameOffset ||
+            !isSafeName(std::string(names + m.nameOffset, m.nameSize)))
+            return fail("bad member name");
+        if (m.offset != end || m.size > hdr.size - end)
+            return fail("inconsistent member table");
+        end += m.size;
+    }
+    const uint64_t dataStart = sizeof(hdr) + metaSize;
+    uint64_t rawEnd = 0;
+    for (size_t i = 0; i < hdr.nblocks; i++)
+    {
+        const BlockEntry& b = table[i];
+        if (b.rawOffset != rawEnd || b.rawSize == 0 ||
+            b.rawSize > hdr.blockSize ||
+            (b.level == 0 && b.cmpSize != b.rawSize))
+            return fail("inconsistent block table");
+        if (b.cmpOffset < dataStart || b.cmpOffset > size ||
+            b.cmpSize > size - b.cmpOffset)
+            return fail("truncated file");
+        rawEnd += b.rawSize;
+    }
+    if (end != hdr.size || rawEnd != hdr.size)
+        return fail("inconsistent block table");
+    return true;
+}
+
+// it inflates (or copies, if stored) the block 'b' of the archive 'ptr' with
+// header 'hdr' and dictionary 'dict' into 'out' and checks its size and CRC32
+static inline bool inflateArchiveBlock(const unsigned char* ptr,
+                                       const ArchiveHeader& hdr,
+                                       const unsigned char* dict,
+                                       const BlockEntry& b, unsigned char* out)
+{
+    const unsigned char* in = ptr + b.cmpOffset;
+    size_t outSize = b.rawSize;
+    if (b.level == 0)
+        std::memcpy(out, in, b.rawSize);
+    else if (hdr.dictSize > 0)
+    {
+        if (!inflateWithDict(dict, hdr.dictSize, in, b.cmpSize, out,
+                             b.rawSize))
+            return false;
+    }
+    else if (uncompress(out, &outSize, in, b.cmpSize) != Z_OK)
+        return false;
+    return outSize == b.rawSize && crc32(MZ_CRC32_INIT, out, outSize) == b.crc;
+}
+
+// it appends to 'files' the regular files of the directory 'path', their
+// names in the archive starting with 'name', and to 'dirs' the directory
+// itself after its subdirectories. The subdirectories are visited only with
+// -r 1
+// returns false in case of error
+static inline bool collectFiles(const std::string& path,
+                                const std::string& name,
+                                std::vector<ArchiveFile>& files,
+                                std::vector<std::string>& dirs)
+{
+    DIR* dir = opendir(path.c_str());
+    if (dir == NULL)
+    {
+        if (QUITE_MODE >= 1)
+        {
+            perror("opendir");
+            std::fprintf(stderr, "Error: opendir %s\n", path.c_str());
+        }
+        return false;
+    }
+    bool ok = true;
+    struct dirent* file;
+    while ((errno = 0, file = readdir(dir)) != NULL)
+    {
+        if (isDotDir(file->d_name))
+            continue;
+        struct stat statbuf;
+        if (fstatat(dirfd(dir), file->d_name, &statbuf, 0) == -1)
+        {
+            if (QUITE_MODE >= 1)
+            {
+                perror("fstatat");
+                std::fprintf(stderr, "Error: stat %s/%s\n", path.c_str(),
+                             file->d_name);
+            }
+            ok = false;
+            continue;
+        }
+        std::string p = path + "/" + file->d_name;
+        std::string n = name + "/" + file->d_name;
+        if (S_ISDIR(statbuf.st_mode))
+        {
+            if (RECUR && !collectFiles(p, n, files, dirs))
+                ok = false;
+            continue;
+        }
+        if (!S_ISREG(statbuf.st_mode) || discardIt(file->d_name, true))
+            continue;
+        files.push_back({std::move(p), std::move(n), size_t(statbuf.st_size),
+                         uint32_t(statbuf.st_mode & 07777)});
+    }
+    if (errno != 0)
+    {
+        if (QUITE_MODE >= 1)
+            perror("readdir");
+        ok = false;
+    }
+    closedir(dir);
+    dirs.push_back(path);
+    return ok;
+}
+
+// the first member with some bytes at 'offset' or after it in the stream
+static inline const MemberEntry* memberAt(const MemberEntry* members,
+                                          size_t nmembers, uint64_t offset)
+{
+    return std::upper_bound(members, members + nmembers, offset,
+                            [](uint64_t o, const MemberEntry& m) {
+                                return o < m.offset + m.size;
+                            });
+}
+
+// it reads the bytes [offset, offset + len) of the stream of the members
+// from their files into 'buf'
+// return false in case of errors
+static inline bool readMembers(const std::vector<ArchiveFile>& files,
+                               const std::vector<MemberEntry>& members,
+                               uint64_t offset, size_t len, unsigned char* buf)
+{
+    const MemberEntry* m = memberAt(members.data(), members.size(), offset);
+    for (; len > 0 && m != members.data() + members.size(); m++)
+    {
+        const size_t skip = offset - m->offset;
+        const size_t n = std::min<uint64_t>(len, m->size - skip);
+        const ArchiveFile& f = files[m - members.data()];
+        int fd = open(f.path.c_str(), O_RDONLY);
+        bool ok = fd >= 0 && readAt(fd, buf, n, skip);
+        if (fd >= 0)
+            close(fd);
+        if (!ok)
+        {
+            if (QUITE_MODE >= 1)
+                std::fprintf(stderr, "Failed to read %s\n", f.path.c_str());
+            return false;
+        }
+        buf += n, offset += n, len -= n;
+    }
+    return len == 0;
+}
+
+// the dictionary, of at most 'size' bytes: the beginnings of up to 32 files
+// spread over the list, where similar files keep the headers, the keys and
+// the formats they have in common
+static inline std::vector<unsigned char>
+trainDictionary(const std::vector<ArchiveFile>& files, size_t size)
+{
+    std::vector<unsigned char> dict;
+    const size_t nsamples = std::min<size_t>(files.size(), 32);
+    if (nsamples == 0 || size == 0)
+        return dict;
+    const size_t piece = (size + nsamples - 1) / nsamples;
+    dict.reserve(size);
+    for (size_t s = 0; s < nsamples && dict.size() < size; s++)
+    {
+        const ArchiveFile& f = files[s * files.size() / nsamples];
+        const size_t n = std::min({piece, f.size, size - dict.size()});
+        int fd = open(f.path.c_str(), O_RDONLY);
+        if (fd < 0)
+            continue; // it is only a sample, the error comes later
+        const size_t old = dict.size();
+        dict.resize(old + n);
+        if (!readAt(fd, dict.data() + old, n, 0))
+            dict.resize(old);
+        close(fd);
+    }
+    return dict;
+}
+
+// what the per-file mode would do with 'files': it reads and compresses
+// them one container each, as compressBlocks() does, without writing them.
+// cmpBytes is the size of the containers, seconds the time taken
+// return false in case of errors
+static inline bool perFileMode(const std::vector<ArchiveFile>& files,
+                               int nthreads, uint64_t& cmpBytes,
+                               double& seconds)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t total = 0;
+    bool error = false;
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)             \
+    reduction(+ : total) reduction(|| : error)
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        thread_local std::vector<unsigned char> raw, cmp;
+        raw.resize(BLOCK_SIZE);
+        cmp.resize(compressBound(BLOCK_SIZE));
+        const ArchiveFile& f = files[i];
+        int fd = open(f.path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            error = true;
+            continue;
+        }
+        total += sizeof(ContainerHeader);
+        for (size_t off = 0; off < f.size; off += BLOCK_SIZE)
+        {
+            const size_t n = std::min(BLOCK_SIZE, f.size - off);
+            if (!readAt(fd, raw.data(), n, off))
+            {
+                error = true;
+                break;
+            }
+            crc32(MZ_CRC32_INIT, raw.data(), n);
+            int level = LEVEL >= 0 ? LEVEL : levelTuner().choose(raw.data(), n);
+            size_t len = cmp.size();
+            if (level == 0 ||
+                compress2(cmp.data(), &len, raw.data(), n, level) != Z_OK ||
+                len >= n)
+                len = n;
+            total += sizeof(BlockEntry) + len;
+        }
+        close(fd);
+    }
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    seconds = t.count();
+    cmpBytes = total;
+    return !error;
+}
+
+// it packs the files of the directory 'dname' (and of its subdirectories with
+// -r 1) into the archive dname + SUFFIX, with a dictionary of DICT_SIZE bytes
+// taken from the files themselves, if any. The blocks of the stream are
+// compressed by nthreads threads in windows of about 2 * nthreads blocks of
+// data, read with pread() into one buffer and compressed into another, from
+// which the window is appended with pwritev(); the tables, whose size is
+// known from the start, are written at the end. With -q 2 it compares the
+// ratio and the throughput with the ones of the per-file mode. With -C 1
+// the files are removed, and then the directories left empty
+// return true if okay, false in case of errors
+static inline bool archiveDir(const char dname[], int nthreads = NTHREADS)
+{
+    namespace fs = std::filesystem;
+    using clock = std::chrono::steady_clock;
+
+    std::string d(dname);
+    while (d.size() > 1 && d.back() == '/')
+        d.pop_back();
+    std::error_code ec;
+    const fs::path root = fs::weakly_canonical(d, ec);
+    const std::string base = root.filename().string();
+    if (ec || base.empty())
+    {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "%s: cannot be archived\n", dname);
+        return false;
+    }
+    // "." or ".." are named after the directory they stand for
+    const std::string outfile =
+        (fs::path(d).filename() == base ? d : root.string()) + SUFFIX;
+
+    std::vector<ArchiveFile> files;
+    std::vector<std::string> dirs;
+    if (!collectFiles(d, base, files, dirs))
+        return false;
+
+    auto start = clock::now();
+    std::vector<unsigned char> dict = trainDictionary(files, DICT_SIZE);
+    std::unique_ptr<DictCompressor> compressor;
+    if (!dict.empty())
+        compressor.reset(new DictCompressor(dict));
+    std::chrono::duration<double> compressTime = clock::now() - start;
+
+    // the tables, but for the positions of the compressed blocks. A solid
+    // archive cuts the stream every BLOCK_SIZE bytes, -d alone also at the
+    // end of every member
+    std::vector<MemberEntry> members(files.size());
+    std::vector<BlockEntry> table;
+    std::string names;
+    uint64_t total = 0;
+    auto cut = [&](uint64_t end) {
+        uint64_t o = table.empty() ? 0
+                                   : table.back().rawOffset +
+                                         table.back().rawSize;
+        for (; o < end; o += table.back().rawSize)
+        {
+            BlockEntry b = {};
+            b.rawOffset = o;
+            b.rawSize = std::min<uint64_t>(BLOCK_SIZE, end - o);
+            table.push_back(b);
+        }
+    };
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        const ArchiveFile& f = files[i];
+        members[i] = {names.size(), f.name.size(), total, f.size, f.mode, 0};
+        names += f.name;
+        total += f.size;
+        if (!ARCHIVE)
+            cut(total);
+    }
+    cut(total);
+    const size_t nblocks = table.size();
+    uint64_t offset = sizeof(ArchiveHeader) +
+                      members.size() * sizeof(MemberEntry) +
+                      nblocks * sizeof(BlockEntry) + names.size() + dict.size();
+
+    int out = open(outfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out < 0)
+    {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "Failed to open output file: %s\n",
+                         outfile.c_str());
+        return false;
+    }
+
+    // the window [first, last) and where its blocks are in the buffers
+    std::vector<unsigned char> raw, cmp;
+    std::vector<size_t> rawOff, cmpOff;
+    std::vector<struct iovec> iov;
+    const size_t windowBytes = 2 * nthreads * BLOCK_SIZE;
+    bool error = false;
+    for (size_t first = 0, last = 0; first < nblocks && !error; first = last)
+    {
+        size_t rawBytes = 0, cmpBytes = 0;
+        rawOff.clear();
+        cmpOff.clear();
+        for (last = first; last < nblocks && (last == first ||
+                                              rawBytes + table[last].rawSize <=
+                                                  windowBytes);
+             last++)
+        {
+            rawOff.push_back(rawBytes);
+            cmpOff.push_back(cmpBytes);
+            rawBytes += table[last].rawSize;
+            cmpBytes += compressBound(table[last].rawSize);
+        }
+        raw.resize(rawBytes);
+        cmp.resize(cmpBytes);
+
+        const size_t n = last - first;
+        auto t0 = clock::now();
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)             \
+    reduction(|| : error)
+        for (size_t j = 0; j < n; j++)
+        {
+            BlockEntry& b = table[first + j];
+            if (!readMembers(files, members, b.rawOffset, b.rawSize,
+                             raw.data() + rawOff[j]))
+            {
+                error = true;
+                continue;
+            }
+            if (!compressBlock(raw.data() + rawOff[j], b,
+                               cmp.data() + cmpOff[j],
+                               compressBound(b.rawSize), compressor.get()))
+            {
+                if (QUITE_MODE >= 1)
+                    std::fprintf(stderr,
+                                 "Failed to compress block %zu of %s\n",
+                                 first + j, outfile.c_str());
+                error = true;
+            }
+        }
+        compressTime += clock::now() - t0;
+        if (error)
+            break;
+
+        iov.clear();
+        for (size_t j = 0; j < n; j++)
+        {
+            BlockEntry& b = table[first + j];
+            b.cmpOffset = offset;
+            offset += b.cmpSize;
+            iov.push_back({cmp.data() + cmpOff[j], b.cmpSize});
+        }
+        if (!writevAt(out, iov.data(), iov.size(), table[first].cmpOffset))
+        {
+            if (QUITE_MODE >= 1)
+                perror("pwritev");
+            error = true;
+        }
+    }
+
+    if (!error)
+    {
+        ArchiveHeader hdr = {{},
+                             ARCHIVE_VERSION,
+                             BLOCK_SIZE,
+                             total,
+                             members.size(),
+                             nblocks,
+                             names.size(),
+                             uint32_t(dict.size()),
+                             0};
+        std::memcpy(hdr.magic, ARCHIVE_MAGIC, sizeof(hdr.magic));
+        iov = {{members.data(), members.size() * sizeof(MemberEntry)},
+               {table.data(), nblocks * sizeof(BlockEntry)},
+               {names.data(), names.size()},
+               {dict.data(), dict.size()}};
+        hdr.tableCrc = MZ_CRC32_INIT;
+        for (const struct iovec& v : iov)
+            if (v.iov_len > 0) // crc32() of a null pointer starts over
+                hdr.tableCrc =
+                    crc32(hdr.tableCrc,
+                          static_cast<const unsigned char*>(v.iov_base),
+                          v.iov_len);
+        iov.insert(iov.begin(), {&hdr, sizeof(hdr)});
+        if (!writevAt(out, iov.data(), iov.size(), 0))
+        {
+            if (QUITE_MODE >= 1)
+                perror("pwritev");
+            error = true;
+        }
+    }
+    if (close(out) < 0)
+        error = true;
+    if (error)
+    {
+        unlink(outfile.c_str());
+        return false;
+    }
+
+    if (QUITE_MODE >= 2 && total > 0)
+    {
+        std::fprintf(stderr,
+                     "%s: %zu files, %.1f MB -> %.1f MB (ratio %.2f), "
+                     "read+compress %.1f MB/s, dictionary %zu bytes\n",
+                     outfile.c_str(), files.size(), total / 1e6, offset / 1e6,
+                     double(total) / offset,
+                     total / compressTime.count() / 1e6, dict.size());
+        uint64_t perFile = 0;
+        double seconds = 0.0;
+        if (perFileMode(files, nthreads, perFile, seconds))
+            std::fprintf(stderr,
+                         "%s: per-file mode %.1f MB -> %.1f MB (ratio %.2f), "
+                         "read+compress %.1f MB/s\n",
+                         outfile.c_str(), total / 1e6, perFile / 1e6,
+                         double(total) / perFile, total / seconds / 1e6);
+    }
+    if (REMOVE_ORIGIN)
+    {
+        for (const ArchiveFile& f : files)
+            unlink(f.path.c_str());
+        // the subdirectories come first, a directory not empty stays
+        for (const std::string& dir : dirs)
+            rmdir(dir.c_str());
+    }
+    return true;
+}
+
+// true if the member 'name' is selected by -m: all of them without -m,
+// otherwise the ones named and the ones below a directory named
+static inline bool isSelected(const std::string& name)
+{
+    if (MEMBERS.empty())
+        return true;
+    for (const std::string& sel : MEMBERS)
+        if (name.compare(0, sel.size(), sel) == 0 &&
+            (name.size() == sel.size() || name[sel.size()] == '/'))
+            return true;
+    return false;
+}
+
+// it extracts the members of the archive pointed by 'ptr' and having size
+// 'size' (fname is its name) next to it, all of them or the ones selected
+// with -m. The directories, and the members lying in more than one block,
+// are created first; then nthreads threads inflate in parallel the blocks
+// holding the selected members, each thread writing the pieces of the
+// members in its block with pwrite(). A member within a single block is
+// created, written and closed by the thread inflating it, so a small file
+// costs a single open()
+// return true if okay, false in case of errors
+static inline bool extractArchive(const unsigned char* ptr, size_t size,
+                                  const std::string& fname,
+                                  int nthreads = NTHREADS)
+{
+    namespace fs = std::filesystem;
+    auto start = std::chrono::steady_clock::now();
+    ArchiveHeader hdr;
+    const MemberEntry* members = nullptr;
+    const BlockEntry* table = nullptr;
+    const char* names = nullptr;
+    const unsigned char* dict = nullptr;
+    if (!checkArchive(ptr, size, fname, hdr, members, table, names, dict))
+        return false;
+
+    const MemberEntry* membersEnd = members + hdr.nmembers;
+    const fs::path dir = fs::path(fname).parent_path();
+    auto path = [&](const MemberEntry& m) {
+        return dir / std::string(names + m.nameOffset, m.nameSize);
+    };
+    // the block holding the byte at 'offset' of the stream
+    auto blockAt = [&](uint64_t offset) -> size_t {
+        return std::upper_bound(table, table + hdr.nblocks, offset,
+                                [](uint64_t o, const BlockEntry& b) {
+                                    return o < b.rawOffset + b.rawSize;
+                                }) -
+               table;
+    };
+
+    // the selected members, the blocks to inflate and the members that no
+    // single block can create (the empty ones too, which have no block)
+    std::vector<char> selected(hdr.nmembers), needed(hdr.nblocks);
+    std::vector<size_t> spanning;
+    size_t nselected = 0;
+    fs::path lastParent;
+    for (size_t i = 0; i < hdr.nmembers; i++)
+    {
+        const MemberEntry& m = members[i];
+        if (!isSelected(std::string(names + m.nameOffset, m.nameSize)))
+            continue;
+        selected[i] = 1;
+        nselected++;
+        fs::path parent = path(m).parent_path();
+        if (parent != lastParent)
+        {
+            std::error_code ec;
+            fs::create_directories(parent, ec);
+            if (ec)
+            {
+                if (QUITE_MODE >= 1)
+                    std::fprintf(stderr, "Error: mkdir %s: %s\n",
+                                 parent.c_str(), ec.message().c_str());
+                return false;
+            }
+            lastParent = std::move(parent);
+        }
+        if (m.size == 0)
+        {
+            spanning.push_back(i);
+            continue;
+        }
+        const size_t first = blockAt(m.offset);
+        const size_t last = blockAt(m.offset + m.size - 1);
+        for (size_t b = first; b <= last; b++)
+            needed[b] = 1;
+        if (last > first)
+            spanning.push_back(i);
+    }
+    if (nselected == 0 && !MEMBERS.empty())
+    {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "%s: no member selected\n", fname.c_str());
+        return false;
+    }
+    std::vector<size_t> blocks;
+    for (size_t b = 0; b < hdr.nblocks; b++)
+        if (needed[b])
+            blocks.push_back(b);
+
+    // bad: a selected member that could not be extracted
+    // created: a member whose file this run has created (or truncated), the
+    // only files that may be removed when something goes wrong
+    bool error = false;
+    std::vector<std::atomic<bool>> bad(hdr.nmembers), created(hdr.nmembers);
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)             \
+    reduction(|| : error)
+    for (size_t k = 0; k < spanning.size(); k++)
+    {
+        const MemberEntry& m = members[spanning[k]];
+        const std::string outfile = path(m).string();
+        int fd = open(outfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0 || ftruncate(fd, m.size) < 0)
+        {
+            if (QUITE_MODE >= 1)
+                std::fprintf(stderr, "Failed to create %s: %s\n",
+                             outfile.c_str(), strerror(errno));
+            bad[spanning[k]] = true;
+            error = true;
+        }
+        if (fd >= 0)
+        {
+            created[spanning[k]] = true;
+            close(fd);
+        }
+    }
+
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)             \
+    reduction(|| : error)
+    for (size_t k = 0; k < blocks.size(); k++)
+    {
+        thread_local std::vector<unsigned char> buf;
+        const BlockEntry& b = table[blocks[k]];
+        const uint64_t end = b.rawOffset + b.rawSize;
+        const MemberEntry* m = memberAt(members, hdr.nmembers, b.rawOffset);
+        buf.resize(b.rawSize);
+        if (!inflateArchiveBlock(ptr, hdr, dict, b, buf.data()))
+        {
+            if (QUITE_MODE >= 1)
+                std::fprintf(stderr, "%s: block %zu is corrupted\n",
+                             fname.c_str(), blocks[k]);
+            for (; m != membersEnd && m->offset < end; m++)
+                if (selected[m - members])
+                    bad[m - members] = true;
+            error = true;
+            continue;
+        }
+        for (; m != membersEnd && m->offset < end; m++)
+        {
+            const size_t i = m - members;
+            if (!selected[i] || m->size == 0 || bad[i])
+                continue;
+            const uint64_t from = std::max(b.rawOffset, m->offset);
+            const uint64_t to = std::min(end, m->offset + m->size);
+            const bool whole = from == m->offset && to == m->offset + m->size;
+            const std::string outfile = path(*m).string();
+            int fd = whole ? open(outfile.c_str(),
+                                  O_WRONLY | O_CREAT | O_TRUNC, 0666)
+                           : open(outfile.c_str(), O_WRONLY);
+            if (fd >= 0 && whole)
+                created[i] = true;
+            bool ok = fd >= 0 &&
+                      writeAt(fd, buf.data() + (from - b.rawOffset),
+                              to - from, from - m->offset) &&
+                      (!whole || fchmod(fd, m->mode) == 0);
+            if (fd >= 0 && close(fd) < 0)
+                ok = false;
+            if (!ok)
+            {
+                if (QUITE_MODE >= 1)
+                    std::fprintf(stderr, "Failed to write %s: %s\n",
+                                 outfile.c_str(), strerror(errno));
+                bad[i] = true;
+                error = true;
+            }
+        }
+    }
+
+    // the permissions last, a member may not be writable
+#pragma omp parallel for num_threads(nthreads) reduction(|| : error)
+    for (size_t k = 0; k < spanning.size(); k++)
+    {
+        const MemberEntry& m = members[spanning[k]];
+        if (!bad[spanning[k]] && chmod(path(m).c_str(), m.mode) < 0)
+        {
+            bad[spanning[k]] = true;
+            error = true;
+        }
+    }
+    if (error)
+    {
+        // do not leave partially extracted members around, but never
+        // touch a file that this run did not create
+        for (size_t i = 0; i < hdr.nmembers; i++)
+            if (bad[i] && created[i])
+                unlink(path(members[i]).c_str());
+        return false;
+    }
+
+    if (QUITE_MODE >= 2)
+    {
+        std::chrono::duration<double> t =
+            std::chrono::steady_clock::now() - start;
+        std::fprintf(stderr,
+                     "%s: %zu of %lu members, %zu of %lu blocks inflated in "
+                     "%.3f s\n",
+                     fname.c_str(), nselected, (unsigned long)hdr.nmembers,
+                     blocks.size(), (unsigned long)hdr.nblocks, t.count());
+    }
+    // the archive goes only when all of it has been extracted
+    if (REMOVE_ORIGIN && MEMBERS.empty())
+    {
+        unlink(fname.c_str());
+    }
+    return true;
+}
+
+#endif // _ARCHIVE_HPP
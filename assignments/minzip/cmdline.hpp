@@ -2,9 +2,11 @@
 #define _CMDLINE_HPP
 
 #include <cstdio>
+#include <getopt.h>
 #include <string>
 
 #include <config.hpp>
+#include <dict.hpp>
 #include <utility.hpp>
 
 static inline void usage(const char* argv0)
@@ -25,17 +27,56 @@ static inline void usage(const char* argv0)
     std::printf(" -q 0 silent mode, 1 prints only error messages to stderr, 2 "
                 "verbose (default q=%d)\n",
                 QUITE_MODE);
+    std::printf(" -t number of threads, parallel version only (default "
+                "t=%d)\n",
+                NTHREADS);
+    std::printf(" -b block size in KB, parallel version only (default "
+                "b=%zu)\n",
+                BLOCK_SIZE / 1024);
+    std::printf(" -p 1 compresses the files of more than one block with a "
+                "reader/workers/writer pipeline, parallel version only "
+                "(default p=%d)\n",
+                PIPELINE ? 1 : 0);
+    std::printf(" -l compression level, from 0 (store) to 9, -1 chooses it "
+                "per block from the data, parallel version only (default "
+                "l=%d)\n",
+                LEVEL);
+    std::printf(" -T throughput target in MB/s, lowers the level chosen per "
+                "block to keep up, parallel version only (default T=%g, no "
+                "target)\n",
+                TARGET_MBS);
+    std::printf(" -a 1 packs every directory into a single solid archive, "
+                "directory%s, parallel version only (default a=%d)\n",
+                SUFFIX, ARCHIVE ? 1 : 0);
+    std::printf(" -d dictionary size in KB, up to %zu: packs every directory "
+                "into an archive whose blocks are compressed against a "
+                "dictionary shared by its files, a block per small file "
+                "unless -a 1; with -a or -d, -q 2 compares the archive with "
+                "the per-file mode, parallel version only (default d=%zu, "
+                "no dictionary)\n",
+                DICT_MAX / 1024, DICT_SIZE / 1024);
+    std::printf(" -m name extracts from the archives only the member name, "
+                "or the members below the directory name; it can be "
+                "repeated, parallel version only\n");
+    std::printf(" -v, --verify checks the integrity of the compressed files "
+                "and archives, and of the ones in the directories, without "
+                "writing anything, parallel version only\n");
+    std::printf(" -x offset:length extracts to stdout the given byte range of "
+                "the original files, parallel version only\n");
     std::printf("--------------------\n");
 }
 
 int parseCommandLine(int argc, char* argv[])
 {
     extern char* optarg;
-    const std::string optstr = "r:C:D:q:";
+    const std::string optstr = "r:C:D:q:t:b:x:p:l:T:d:a:m:v";
+    const struct option longopts[] = {{"verify", no_argument, nullptr, 'v'},
+                                      {nullptr, 0, nullptr, 0}};
     long opt, start = 1;
     bool cpresent = false, dpresent = false;
 
-    while ((opt = getopt(argc, argv, optstr.c_str())) != -1)
+    while ((opt = getopt_long(argc, argv, optstr.c_str(), longopts,
+                              nullptr)) != -1)
     {
         switch (opt)
         {
@@ -91,6 +132,133 @@ int parseCommandLine(int argc, char* argv[])
             start += 2;
         }
         break;
+        case 't': {
+            long t = 0;
+            if (!isNumber(optarg, t) || t <= 0)
+            {
+                std::fprintf(stderr, "Error: wrong '-t' option\n");
+                usage(argv[0]);
+                return -1;
+            }
+            NTHREADS = t;
+            start += 2;
+        }
+        break;
+        case 'b': {
+            long b = 0;
+            if (!isNumber(optarg, b) || b <= 0)
+            {
+                std::fprintf(stderr, "Error: wrong '-b' option\n");
+                usage(argv[0]);
+                return -1;
+            }
+            BLOCK_SIZE = b * 1024;
+            start += 2;
+        }
+        break;
+        case 'p': {
+            long p = 0;
+            if (!isNumber(optarg, p))
+            {
+                std::fprintf(stderr, "Error: wrong '-p' option\n");
+                usage(argv[0]);
+                return -1;
+            }
+            PIPELINE = (p == 1);
+            start += 2;
+        }
+        break;
+        case 'l': {
+            long l = 0;
+            if (!isNumber(optarg, l) || l < -1 || l > MZ_BEST_COMPRESSION)
+            {
+                std::fprintf(stderr, "Error: wrong '-l' option\n");
+                usage(argv[0]);
+                return -1;
+            }
+            LEVEL = l;
+            start += 2;
+        }
+        break;
+        case 'T': {
+            long t = 0;
+            if (!isNumber(optarg, t) || t < 0)
+            {
+                std::fprintf(stderr, "Error: wrong '-T' option\n");
+                usage(argv[0]);
+                return -1;
+            }
+            TARGET_MBS = t;
+            start += 2;
+        }
+        break;
+        case 'd': {
+            long d = 0;
+            if (!isNumber(optarg, d) || d < 0 || size_t(d) * 1024 > DICT_MAX)
+            {
+                std::fprintf(stderr, "Error: wrong '-d' option\n");
+                usage(argv[0]);
+                return -1;
+            }
+            DICT_SIZE = d * 1024;
+            start += 2;
+        }
+        break;
+        case 'a': {
+            long a = 0;
+            if (!isNumber(optarg, a))
+            {
+                std::fprintf(stderr, "Error: wrong '-a' option\n");
+                usage(argv[0]);
+                return -1;
+            }
+            ARCHIVE = (a == 1);
+            start += 2;
+        }
+        break;
+        case 'm': {
+            std::string name(optarg);
+            while (name.size() > 1 && name.back() == '/')
+                name.pop_back();
+            if (name.empty())
+            {
+                std::fprintf(stderr, "Error: wrong '-m' option\n");
+                usage(argv[0]);
+                return -1;
+            }
+            dpresent = true;
+            MEMBERS.push_back(name);
+            COMP = false; // selecting members is extracting them
+            start += 2;
+        }
+        break;
+        case 'v': {
+            dpresent = true;
+            VERIFY = true;
+            COMP = false; // the compressed files are the ones to look at
+            start += 1;
+        }
+        break;
+        case 'x': {
+            std::string range(optarg);
+            size_t colon = range.find(':');
+            long o = 0, l = 0;
+            if (colon == std::string::npos ||
+                !isNumber(range.substr(0, colon).c_str(), o) ||
+                !isNumber(range.substr(colon + 1).c_str(), l) || o < 0 ||
+                l <= 0)
+            {
+                std::fprintf(stderr, "Error: wrong '-x' option\n");
+                usage(argv[0]);
+                return -1;
+            }
+            dpresent = true;
+            RANGE_OFFSET = o;
+            RANGE_LENGTH = l;
+            COMP = false; // extracting is decompressing
+            start += 2;
+        }
+        break;
         default:
             usage(argv[0]);
             return -1;
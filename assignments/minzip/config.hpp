@@ -2,6 +2,9 @@
 #define _CONFIG_HPP
 
 #include <miniz/miniz.h>
+#include <string>
+#include <thread>
+#include <vector>
 
 #define SUFFIX ".zip"
 constexpr int BUF_SIZE = (1024 * 1024);
@@ -12,4 +15,19 @@ static bool REMOVE_ORIGIN = false; // Does it keep the origin file?
 static int QUITE_MODE = 1;         // 0 silent, 1 error messages, 2 verbose
 static bool RECUR = false; // do we have to process the contents of subdirs?
 
+// parallel version (minizpar) only
+static int NTHREADS = std::thread::hardware_concurrency(); // thread team size
+static size_t BLOCK_SIZE = 1024 * 1024; // bytes of input per block
+static size_t RANGE_OFFSET = 0; // -x: bytes to skip before the range
+static size_t RANGE_LENGTH = 0; // -x: bytes of the range, 0 is no range
+static bool PIPELINE = false;   // -p: reader/workers/writer pipeline
+static int LEVEL = -1;          // -l: 0 (store) to 9, -1 chosen per block
+static double TARGET_MBS = 0.0; // -T: throughput target in MB/s, 0 is none
+static size_t DICT_SIZE = 0;    // -d: bytes of the shared dictionary, 0 none
+static bool ARCHIVE = false;    // -a: a solid archive for every directory
+static std::vector<std::string> MEMBERS; // -m: to extract, all if empty
+static bool VERIFY = false; // --verify: check the files, write nothing
+constexpr size_t SMALL_FILE = 64 * 1024; // smaller files are batched in a job
+constexpr size_t BATCH_FILES = 64;       // at most these files in a batch
+
 #endif // _CONFIG_HPP
@@ -0,0 +1,568 @@
+#if !defined _CONTAINER_HPP
+#define _CONTAINER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <sys/uio.h>
+#include <vector>
+
+#include <omp.h>
+
+#include <config.hpp>
+#include <dict.hpp>
+#include <level.hpp>
+#include <pool.hpp>
+#include <utility.hpp>
+
+// minzip block container, written by the parallel version (minizpar)
+//
+//   ContainerHeader | BlockEntry[nblocks] | block 0 | block 1 | ...
+//
+// the input file is split into blocks of blockSize bytes (the last one may
+// be shorter), and every block is compressed into an independent zlib
+// stream, so the blocks can be compressed and inflated in any order, and a
+// byte range can be extracted inflating only the blocks that cover it.
+// Every entry of the block table has the position of the block in both the
+// container and the original file, the CRC32 of its original bytes and the
+// level it was compressed at, 0 being a block stored as it is; the table has
+// its own CRC32 in the header. The integers are stored in the byte order of
+// the machine. Version 2 had no levels (all the blocks are zlib streams).
+
+constexpr char CONTAINER_MAGIC[4] = {'M', 'Z', 'P', 'B'};
+constexpr uint32_t CONTAINER_VERSION = 3;
+
+struct ContainerHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t blockSize; // bytes of input per block
+    uint64_t size;      // size of the original file
+    uint64_t nblocks;
+    uint32_t tableCrc; // CRC32 of the block table
+    uint32_t reserved;
+};
+
+struct BlockEntry
+{
+    uint64_t cmpOffset; // from the beginning of the container
+    uint64_t cmpSize;
+    uint64_t rawOffset; // from the beginning of the original file
+    uint64_t rawSize;
+    uint32_t crc;   // CRC32 of the original bytes
+    uint32_t level; // 0 stored, 1-9 zlib stream (version 3)
+};
+
+// true if the data pointed by 'ptr' starts with a container header
+static inline bool isContainer(const unsigned char* ptr, size_t size)
+{
+    return size >= sizeof(ContainerHeader) &&
+           std::memcmp(ptr, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) == 0;
+}
+
+// true if the block 'b' is stored as it is
+static inline bool isStored(const ContainerHeader& hdr, const BlockEntry& b)
+{
+    return hdr.version >= 3 && b.level == 0;
+}
+
+// it checks the header and the block table of the container pointed by
+// 'ptr' and having size 'size', without inflating the blocks: a truncated
+// file, a corrupted table or a block out of the file are all errors.
+// If everything is ok, hdr is the header and table points to the block table
+static inline bool checkContainer(const unsigned char* ptr, size_t size,
+                                  const std::string& fname,
+                                  ContainerHeader& hdr,
+                                  const BlockEntry*& table)
+{
+    auto fail = [&](const char* what) {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "%s: %s\n", fname.c_str(), what);
+        return false;
+    };
+    if (!isContainer(ptr, size))
+        return fail("not a minzip container");
+    std::memcpy(&hdr, ptr, sizeof(hdr));
+    if (hdr.version != CONTAINER_VERSION && hdr.version != 2)
+        return fail("unsupported container version");
+    if (hdr.nblocks > (size - sizeof(hdr)) / sizeof(BlockEntry))
+        return fail("truncated block table");
+
+    const size_t tableSize = hdr.nblocks * sizeof(BlockEntry);
+    table = reinterpret_cast<const BlockEntry*>(ptr + sizeof(hdr));
+    if (crc32(MZ_CRC32_INIT, ptr + sizeof(hdr), tableSize) != hdr.tableCrc)
+        return fail("corrupted block table");
+
+    // the blocks cover the original file in order and lie in the container
+    uint64_t rawEnd = 0;
+    for (size_t i = 0; i < hdr.nblocks; i++)
+    {
+        const BlockEntry& b = table[i];
+        if (b.rawOffset != rawEnd || b.rawSize > hdr.blockSize ||
+            (isStored(hdr, b) && b.cmpSize != b.rawSize))
+            return fail("inconsistent block table");
+        if (b.cmpOffset < sizeof(hdr) + tableSize || b.cmpOffset > size ||
+            b.cmpSize > size - b.cmpOffset)
+            return fail("truncated file");
+        rawEnd += b.rawSize;
+    }
+    if (rawEnd != hdr.size)
+        return fail("inconsistent block table");
+    return true;
+}
+
+// it inflates (or copies, if stored) the block 'b' of the container 'ptr'
+// with header 'hdr' into 'out' and checks its size and CRC32
+static inline bool inflateBlock(const unsigned char* ptr,
+                                const ContainerHeader& hdr,
+                                const BlockEntry& b, unsigned char* out)
+{
+    size_t outSize = b.rawSize;
+    if (isStored(hdr, b))
+        std::memcpy(out, ptr + b.cmpOffset, b.rawSize);
+    else if (uncompress(out, &outSize, ptr + b.cmpOffset, b.cmpSize) != Z_OK)
+        return false;
+    return outSize == b.rawSize && crc32(MZ_CRC32_INIT, out, outSize) == b.crc;
+}
+
+// the buffers of the original and of the compressed blocks, created at the
+// first use, when BLOCK_SIZE is known
+static inline BufferPool& rawPool()
+{
+    static BufferPool pool(BLOCK_SIZE);
+    return pool;
+}
+static inline BufferPool& cmpPool()
+{
+    static BufferPool pool(compressBound(BLOCK_SIZE));
+    return pool;
+}
+
+// the header of the container of a file of size 'size' with the given table
+static inline ContainerHeader makeHeader(uint64_t size,
+                                         const std::vector<BlockEntry>& table)
+{
+    ContainerHeader hdr = {{}, CONTAINER_VERSION, BLOCK_SIZE, size,
+                           table.size(), 0, 0};
+    std::memcpy(hdr.magic, CONTAINER_MAGIC, sizeof(hdr.magic));
+    hdr.tableCrc = crc32(MZ_CRC32_INIT,
+                         reinterpret_cast<const unsigned char*>(table.data()),
+                         table.size() * sizeof(BlockEntry));
+    return hdr;
+}
+
+// read (write) exactly 'len' bytes at 'offset' of the file 'fd'
+static inline bool readAt(int fd, unsigned char* buf, size_t len, off_t offset)
+{
+    while (len > 0)
+    {
+        ssize_t r = pread(fd, buf, len, offset);
+        if (r <= 0) // an error, or the file is shorter than expected
+            return false;
+        buf += r, len -= r, offset += r;
+    }
+    return true;
+}
+static inline bool writeAt(int fd, const unsigned char* buf, size_t len,
+                           off_t offset)
+{
+    while (len > 0)
+    {
+        ssize_t r = pwrite(fd, buf, len, offset);
+        if (r < 0)
+            return false;
+        buf += r, len -= r, offset += r;
+    }
+    return true;
+}
+// write the 'iovcnt' buffers of 'iov' one after the other from 'offset' of
+// the file 'fd' with as few pwritev() as possible. iov is modified
+static inline bool writevAt(int fd, struct iovec* iov, int iovcnt, off_t offset)
+{
+    while (iovcnt > 0)
+    {
+        ssize_t r = pwritev(fd, iov, std::min(iovcnt, IOV_MAX), offset);
+        if (r < 0)
+            return false;
+        offset += r;
+        // skip what has been written, maybe stopping in the middle of a buffer
+        while (iovcnt > 0 && size_t(r) >= iov->iov_len)
+        {
+            r -= iov->iov_len;
+            iov++, iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + r;
+            iov->iov_len -= r;
+        }
+    }
+    return true;
+}
+
+// it compresses the rawSize bytes of the block 'b' pointed by 'raw' into 'cmp'
+// (a buffer of cmpPool(), or of cmpCap bytes), at the level of -l or at the
+// one of the levelTuner(), and stores them as they are if they would not
+// shrink. With a 'dict' the block is a raw deflate stream that continues the
+// dictionary instead of a zlib stream. It fills crc, cmpSize and level of 'b'
+// return true if okay, false in case of errors
+static inline bool compressBlock(const unsigned char* raw, BlockEntry& b,
+                                 unsigned char* cmp, size_t cmpCap = 0,
+                                 DictCompressor* dict = nullptr)
+{
+    auto start = std::chrono::steady_clock::now();
+    b.crc = crc32(MZ_CRC32_INIT, raw, b.rawSize);
+    int level = LEVEL >= 0 ? LEVEL : levelTuner().choose(raw, b.rawSize);
+
+    size_t cmp_len = cmpCap > 0 ? cmpCap : cmpPool().bufSize();
+    if (level > 0 && dict != nullptr)
+    {
+        if (!dict->compress(raw, b.rawSize, cmp, cmp_len, level))
+            return false;
+    }
+    else if (level > 0 &&
+             compress2(cmp, &cmp_len, raw, b.rawSize, level) != Z_OK)
+        return false;
+    if (level == 0 || cmp_len >= b.rawSize)
+    {
+        std::memcpy(cmp, raw, b.rawSize);
+        cmp_len = b.rawSize;
+        level = 0;
+    }
+    b.cmpSize = cmp_len;
+    b.level = level;
+
+    std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+    levelTuner().update(level, b.rawSize, t.count());
+    return true;
+}
+
+// it compresses the data pointed by 'ptr' and having size 'size' in blocks of
+// BLOCK_SIZE bytes, using nthreads threads, and writes the container fname +
+// SUFFIX. The blocks are compressed into buffers of the pool and written from
+// there, together with the header and the table, by pwritev()
+// return true if okay, false in case of errors
+static inline bool compressBlocks(unsigned char* ptr, size_t size,
+                                  const std::string& fname,
+                                  int nthreads = NTHREADS)
+{
+    const size_t nblocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    std::vector<unsigned char*> blocks(nblocks, nullptr);
+    std::vector<BlockEntry> table(nblocks);
+
+    // the blocks are independent, the schedule is dynamic because they do
+    // not compress at the same speed
+    bool error = false;
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)             \
+    reduction(|| : error)
+    for (size_t i = 0; i < nblocks; i++)
+    {
+        BlockEntry& b = table[i];
+        b.rawOffset = i * BLOCK_SIZE;
+        b.rawSize = std::min(BLOCK_SIZE, size - b.rawOffset);
+        blocks[i] = cmpPool().get();
+        if (!compressBlock(ptr + b.rawOffset, b, blocks[i]))
+        {
+            if (QUITE_MODE >= 1)
+                std::fprintf(stderr, "Failed to compress block %zu of %s\n",
+                             i, fname.c_str());
+            error = true;
+        }
+    }
+
+    // the blocks follow the table in order
+    uint64_t offset = sizeof(ContainerHeader) + nblocks * sizeof(BlockEntry);
+    for (BlockEntry& b : table)
+    {
+        b.cmpOffset = offset;
+        offset += b.cmpSize;
+    }
+
+    std::string outfile = fname + SUFFIX;
+    if (!error)
+    {
+        int out = open(outfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (out < 0)
+        {
+            std::fprintf(stderr, "Failed to open output file: %s\n",
+                         outfile.c_str());
+            error = true;
+        }
+        else
+        {
+            ContainerHeader hdr = makeHeader(size, table);
+            std::vector<struct iovec> iov;
+            iov.push_back({&hdr, sizeof(hdr)});
+            iov.push_back({table.data(), nblocks * sizeof(BlockEntry)});
+            for (size_t i = 0; i < nblocks; i++)
+                iov.push_back({blocks[i], table[i].cmpSize});
+            if (!writevAt(out, iov.data(), iov.size(), 0) || close(out) < 0)
+            {
+                if (QUITE_MODE >= 1)
+                    std::fprintf(stderr, "Failed to write %s\n",
+                                 outfile.c_str());
+                unlink(outfile.c_str());
+                error = true;
+            }
+        }
+    }
+
+    for (unsigned char* b : blocks)
+        if (b != nullptr)
+            cmpPool().put(b);
+
+    if (!error && REMOVE_ORIGIN)
+    {
+        unlink(fname.c_str());
+    }
+    return !error;
+}
+
+// it compresses the file fname of size 'size' like compressBlocks() but in
+// constant memory, whatever the size of the file: the file is not mapped,
+// windows of 2 * nthreads blocks are read with pread() into the same input
+// buffers, compressed in parallel into the same output buffers and appended
+// to the container, every thread writing its blocks at their offsets. The
+// block table, whose space is left after the header, is written at the end.
+// Only the table grows with the file (40 bytes per block), and the pages
+// already compressed are dropped from the page cache.
+// return true if okay, false in case of errors
+static inline bool compressStream(const char fname[], size_t size,
+                                  int nthreads = NTHREADS)
+{
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0)
+    {
+        if (QUITE_MODE >= 1)
+        {
+            perror("open");
+            std::fprintf(stderr, "Failed opening file %s\n", fname);
+        }
+        return false;
+    }
+    std::string outfile = std::string(fname) + SUFFIX;
+    int out = open(outfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out < 0)
+    {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "Failed to open output file: %s\n",
+                         outfile.c_str());
+        close(fd);
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    const size_t nblocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const size_t window = std::min<size_t>(2 * nthreads, nblocks);
+    std::vector<BlockEntry> table(nblocks);
+    std::vector<unsigned char*> in(window), cmp(window);
+    for (size_t j = 0; j < window; j++)
+    {
+        in[j] = rawPool().get();
+        cmp[j] = cmpPool().get();
+    }
+
+    uint64_t offset = sizeof(ContainerHeader) + nblocks * sizeof(BlockEntry);
+    bool error = false;
+    for (size_t first = 0; first < nblocks && !error; first += window)
+    {
+        const size_t n = std::min(window, nblocks - first);
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)             \
+    reduction(|| : error)
+        for (size_t j = 0; j < n; j++)
+        {
+            BlockEntry& b = table[first + j];
+            b.rawOffset = (first + j) * BLOCK_SIZE;
+            b.rawSize = std::min(BLOCK_SIZE, size - b.rawOffset);
+            if (!readAt(fd, in[j], b.rawSize, b.rawOffset))
+            {
+                if (QUITE_MODE >= 1)
+                    std::fprintf(stderr, "Failed to read block %zu of %s\n",
+                                 first + j, fname);
+                error = true;
+                continue;
+            }
+            if (!compressBlock(in[j], b, cmp[j]))
+            {
+                if (QUITE_MODE >= 1)
+                    std::fprintf(stderr,
+                                 "Failed to compress block %zu of %s\n",
+                                 first + j, fname);
+                error = true;
+            }
+        }
+
+        if (error)
+            break;
+
+        // once the sizes are known, every block of the window has its
+        // place and the threads write them concurrently
+        for (size_t j = 0; j < n; j++)
+        {
+            table[first + j].cmpOffset = offset;
+            offset += table[first + j].cmpSize;
+        }
+#pragma omp parallel for num_threads(nthreads) reduction(|| : error)
+        for (size_t j = 0; j < n; j++)
+        {
+            const BlockEntry& b = table[first + j];
+            if (!writeAt(out, cmp[j], b.cmpSize, b.cmpOffset))
+            {
+                if (QUITE_MODE >= 1)
+                    perror("pwrite");
+                error = true;
+            }
+        }
+        posix_fadvise(fd, first * BLOCK_SIZE, n * BLOCK_SIZE,
+                      POSIX_FADV_DONTNEED);
+    }
+
+    if (!error)
+    {
+        ContainerHeader hdr = makeHeader(size, table);
+        if (!writeAt(out, reinterpret_cast<const unsigned char*>(&hdr),
+                     sizeof(hdr), 0) ||
+            !writeAt(out, reinterpret_cast<const unsigned char*>(table.data()),
+                     nblocks * sizeof(BlockEntry), sizeof(hdr)))
+        {
+            if (QUITE_MODE >= 1)
+                perror("pwrite");
+            error = true;
+        }
+    }
+    for (size_t j = 0; j < window; j++)
+    {
+        rawPool().put(in[j]);
+        cmpPool().put(cmp[j]);
+    }
+    close(fd);
+    if (close(out) < 0)
+        error = true;
+
+    if (error)
+    {
+        unlink(outfile.c_str());
+        return false;
+    }
+    if (REMOVE_ORIGIN)
+    {
+        unlink(fname);
+    }
+    return true;
+}
+
+// it decompresses the container pointed by 'ptr' and having size 'size',
+// inflating the blocks in parallel directly into the mapped output file
+// fname stores the file name of the container
+// return true if okay, false in case of errors
+static inline bool decompressBlocks(unsigned char* ptr, size_t size,
+                                    const std::string& fname,
+                                    int nthreads = NTHREADS)
+{
+    ContainerHeader hdr;
+    const BlockEntry* table = nullptr;
+    if (!checkContainer(ptr, size, fname, hdr, table))
+        return false;
+
+    unsigned char* decompressed_data = nullptr;
+    std::string outfile =
+        fname.substr(0, fname.size() - 4); // remove the SUFFIX (i.e., .zip)
+    if (hdr.size == 0)
+    {
+        // an empty file cannot be mapped
+        std::ofstream outFile(outfile, std::ios::binary);
+        if (REMOVE_ORIGIN && outFile.is_open())
+            unlink(fname.c_str());
+        return outFile.is_open();
+    }
+    if (!allocateFile(outfile.c_str(), hdr.size, decompressed_data))
+        return false;
+
+    bool error = false;
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)             \
+    reduction(|| : error)
+    for (size_t i = 0; i < hdr.nblocks; i++)
+    {
+        const BlockEntry& b = table[i];
+        if (!inflateBlock(ptr, hdr, b, decompressed_data + b.rawOffset))
+        {
+            if (QUITE_MODE >= 1)
+                std::fprintf(stderr, "%s: block %zu is corrupted\n",
+                             fname.c_str(), i);
+            error = true;
+        }
+    }
+    unmapFile(decompressed_data, hdr.size);
+
+    if (error)
+    {
+        // do not leave a partially inflated file around
+        unlink(outfile.c_str());
+        return false;
+    }
+    if (REMOVE_ORIGIN)
+    {
+        unlink(fname.c_str());
+    }
+    return true;
+}
+
+// it writes to 'out' the bytes [offset, offset + length) of the file stored
+// in the container pointed by 'ptr', inflating (in parallel) only the blocks
+// that cover them. The range is clipped to the end of the file.
+// return true if okay, false in case of errors
+static inline bool extractRange(unsigned char* ptr, size_t size,
+                                const std::string& fname, size_t offset,
+                                size_t length, std::FILE* out)
+{
+    ContainerHeader hdr;
+    const BlockEntry* table = nullptr;
+    if (!checkContainer(ptr, size, fname, hdr, table))
+        return false;
+    if (offset >= hdr.size || length == 0)
+        return true;
+    length = std::min<size_t>(length, hdr.size - offset);
+
+    // first block ending after offset, last block starting before the end
+    const BlockEntry* end = table + hdr.nblocks;
+    const BlockEntry* first = std::upper_bound(
+        table, end, offset, [](size_t o, const BlockEntry& b) {
+            return o < b.rawOffset + b.rawSize;
+        });
+    const BlockEntry* last = std::upper_bound(
+        first, end, offset + length - 1,
+        [](size_t o, const BlockEntry& b) { return o < b.rawOffset; });
+    const size_t n = last - first;
+
+    std::vector<unsigned char> buf(last[-1].rawOffset + last[-1].rawSize -
+                                   first->rawOffset);
+    bool error = false;
+#pragma omp parallel for schedule(dynamic) num_threads(NTHREADS)             \
+    reduction(|| : error)
+    for (size_t i = 0; i < n; i++)
+    {
+        const BlockEntry& b = first[i];
+        unsigned char* out = buf.data() + b.rawOffset - first->rawOffset;
+        if (!inflateBlock(ptr, hdr, b, out))
+        {
+            if (QUITE_MODE >= 1)
+                std::fprintf(stderr, "%s: block %zu is corrupted\n",
+                             fname.c_str(), size_t(&b - table));
+            error = true;
+        }
+    }
+    if (error)
+        return false;
+
+    if (std::fwrite(buf.data() + offset - first->rawOffset, 1, length, out) !=
+        length)
+    {
+        if (QUITE_MODE >= 1)
+            perror("fwrite");
+        return false;
+    }
+    return true;
+}
+
+#endif // _CONTAINER_HPP
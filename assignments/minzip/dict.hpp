@@ -0,0 +1,152 @@
+#if !defined _DICT_HPP
+#define _DICT_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <config.hpp>
+
+// Compression against a preset dictionary shared by many small files (-d).
+//
+// miniz has no deflateSetDictionary(), but a deflate stream can refer to the
+// last 32 KB it has seen, whatever they are. So the dictionary is given to
+// the compressor as if it was the beginning of the data, followed by a sync
+// flush that ends its output on a byte boundary: what the compressor writes
+// from there on is a raw deflate stream whose matches may reach back into
+// the dictionary. The compressor primed in this way is copied for every
+// block, instead of compressing the dictionary again each time. On the other
+// side, the inflater is given an output buffer that already starts with the
+// dictionary, so that the references into it resolve as usual.
+
+constexpr size_t DICT_MAX = TDEFL_LZ_DICT_SIZE; // the deflate window, 32 KB
+
+class DictCompressor
+{
+public:
+    explicit DictCompressor(std::vector<unsigned char> dict)
+        : m_dict(std::move(dict))
+    {
+    }
+
+    DictCompressor(const DictCompressor&) = delete;
+    DictCompressor& operator=(const DictCompressor&) = delete;
+
+    const std::vector<unsigned char>& dict() const { return m_dict; }
+
+    // it compresses the inLen bytes of 'in' at 'level' (1-9) into 'out', a
+    // buffer of outLen bytes; outLen becomes the size of the stream
+    // return false if it does not fit, or in case of errors
+    bool compress(const unsigned char* in, size_t inLen, unsigned char* out,
+                  size_t& outLen, int level)
+    {
+        const tdefl_compressor* primed = prime(level);
+        if (primed == nullptr)
+            return false;
+        // a compressor is some hundreds of KB, each thread keeps its own
+        thread_local std::unique_ptr<tdefl_compressor> work(
+            new tdefl_compressor);
+        copy(work.get(), primed);
+        size_t n = inLen;
+        return tdefl_compress(work.get(), in, &n, out, &outLen,
+                              TDEFL_FINISH) == TDEFL_STATUS_DONE &&
+               n == inLen;
+    }
+
+private:
+    // the compressor at 'level' that has already seen the dictionary,
+    // created by the first thread asking for it
+    const tdefl_compressor* prime(int level)
+    {
+        std::call_once(m_once[level], [&]() {
+            std::unique_ptr<tdefl_compressor> c(new tdefl_compressor);
+            mz_uint flags = tdefl_create_comp_flags_from_zip_params(
+                level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+            if (tdefl_init(c.get(), nullptr, nullptr, flags) !=
+                TDEFL_STATUS_OKAY)
+                return;
+            // the output up to the flush is not needed by anybody
+            std::vector<unsigned char> sink(compressBound(m_dict.size()));
+            size_t in = m_dict.size(), out = sink.size();
+            if (tdefl_compress(c.get(), m_dict.data(), &in, sink.data(), &out,
+                               TDEFL_SYNC_FLUSH) == TDEFL_STATUS_OKAY &&
+                in == m_dict.size())
+                m_primed[level] = std::move(c);
+        });
+        return m_primed[level].get();
+    }
+
+    // a compressor is a plain struct, but after a flush its LZ codes and
+    // output buffers are empty and need not be copied, and the pointers into
+    // them have to follow them
+    static void copy(tdefl_compressor* dst, const tdefl_compressor* src)
+    {
+        // the layout of the miniz this was written for: the LZ codes, then
+        // the hash chains, then the output buffer, followed at most by the
+        // padding of the struct
+        static_assert(offsetof(tdefl_compressor, m_lz_code_buf) <
+                          offsetof(tdefl_compressor, m_next),
+                      "unexpected tdefl_compressor layout");
+        static_assert(offsetof(tdefl_compressor, m_lz_code_buf) +
+                              sizeof(tdefl_compressor::m_lz_code_buf) ==
+                          offsetof(tdefl_compressor, m_next),
+                      "unexpected tdefl_compressor layout");
+        static_assert(offsetof(tdefl_compressor, m_next) <
+                          offsetof(tdefl_compressor, m_output_buf),
+                      "unexpected tdefl_compressor layout");
+        static_assert(sizeof(tdefl_compressor) -
+                              offsetof(tdefl_compressor, m_output_buf) -
+                              sizeof(tdefl_compressor::m_output_buf) <
+                          alignof(tdefl_compressor),
+                      "unexpected tdefl_compressor layout");
+
+        const size_t lz = offsetof(tdefl_compressor, m_lz_code_buf);
+        const size_t next = offsetof(tdefl_compressor, m_next);
+        const size_t output = offsetof(tdefl_compressor, m_output_buf);
+        std::memcpy(dst, src, lz);
+        std::memcpy(reinterpret_cast<char*>(dst) + next,
+                    reinterpret_cast<const char*>(src) + next, output - next);
+        // the flags of the next codes are shifted in, not assigned
+        dst->m_lz_code_buf[0] = src->m_lz_code_buf[0];
+
+        auto rebase = [&](mz_uint8*& p, const mz_uint8* from, mz_uint8* to) {
+            p = to + (p - from);
+        };
+        rebase(dst->m_pLZ_code_buf, src->m_lz_code_buf, dst->m_lz_code_buf);
+        rebase(dst->m_pLZ_flags, src->m_lz_code_buf, dst->m_lz_code_buf);
+        rebase(dst->m_pOutput_buf, src->m_output_buf, dst->m_output_buf);
+        rebase(dst->m_pOutput_buf_end, src->m_output_buf, dst->m_output_buf);
+    }
+
+    std::vector<unsigned char> m_dict;
+    std::once_flag m_once[MZ_BEST_COMPRESSION + 1];
+    std::unique_ptr<tdefl_compressor> m_primed[MZ_BEST_COMPRESSION + 1];
+};
+
+// it inflates the raw deflate stream of inLen bytes 'in', written by a
+// DictCompressor with the dictionary 'dict', into the rawSize bytes of 'out'
+// return true if okay, false if the stream is corrupted or of another size
+static inline bool inflateWithDict(const unsigned char* dict, size_t dictSize,
+                                   const unsigned char* in, size_t inLen,
+                                   unsigned char* out, size_t rawSize)
+{
+    // the dictionary is the history in front of the output
+    thread_local std::vector<unsigned char> buf;
+    buf.resize(dictSize + rawSize);
+    std::memcpy(buf.data(), dict, dictSize);
+
+    tinfl_decompressor inflator;
+    tinfl_init(&inflator);
+    size_t n = inLen, outLen = rawSize;
+    tinfl_status s = tinfl_decompress(
+        &inflator, in, &n, buf.data(), buf.data() + dictSize, &outLen,
+        TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF);
+    if (s != TINFL_STATUS_DONE || outLen != rawSize)
+        return false;
+    std::memcpy(out, buf.data() + dictSize, rawSize);
+    return true;
+}
+
+#endif // _DICT_HPP
@@ -0,0 +1,63 @@
+#if !defined _DOWORK_HPP
+#define _DOWORK_HPP
+
+#include <archive.hpp>
+#include <config.hpp>
+#include <container.hpp>
+#include <pipeline.hpp>
+#include <utility.hpp>
+#include <verify.hpp>
+
+// entry-point of the parallel version. The files written by minizseq (with
+// no container header) are still decompressed by decompressData(), the
+// archives of a directory are extracted by extractArchive(). If a
+// range was given with -x, it is extracted to the standard output instead,
+// with --verify the file is only checked by verifyFile().
+// The blocks of a file are processed by a team of nthreads threads, the
+// files of more than one block are compressed by compressStream(), or by
+// compressPipeline() with -p 1
+// returns false in case of error
+static inline bool doWorkBlocks(const char fname[], size_t size,
+                                const bool comp, int nthreads = NTHREADS)
+{
+    if (comp && size > BLOCK_SIZE)
+        return PIPELINE ? compressPipeline(fname, size, nthreads)
+                        : compressStream(fname, size, nthreads);
+
+    unsigned char* ptr = nullptr;
+    if (size == 0 && comp)
+    {
+        // mmap fails on empty files, the container has just the header
+        return compressBlocks(ptr, 0, fname, nthreads);
+    }
+    if (size == 0 && VERIFY)
+    {
+        // nothing to map, and not a valid file of any kind
+        return verifyFile(ptr, 0, fname, nthreads);
+    }
+    if (!mapFile(fname, size, ptr))
+    {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "mapFile %s failed\n", fname);
+        return false;
+    }
+    bool r;
+    if (VERIFY)
+        r = verifyFile(ptr, size, fname, nthreads);
+    else if (comp)
+        r = compressBlocks(ptr, size, fname, nthreads);
+    else if (RANGE_LENGTH > 0)
+        r = extractRange(ptr, size, fname, RANGE_OFFSET, RANGE_LENGTH,
+                         stdout);
+    else if (isContainer(ptr, size))
+        r = decompressBlocks(ptr, size, fname, nthreads);
+    else if (isArchive(ptr, size))
+        r = extractArchive(ptr, size, fname, nthreads);
+    else
+        r = decompressData(ptr, size, fname);
+
+    unmapFile(ptr, size);
+    return r;
+}
+
+#endif // _DOWORK_HPP
@@ -0,0 +1,112 @@
+#if !defined _LEVEL_HPP
+#define _LEVEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#include <config.hpp>
+
+// Choice of the compression level of every block (-l -1, the default).
+//
+// The level is taken from a ladder going from the fastest to the best ratio:
+// stored as it is (0), MZ_BEST_SPEED, MZ_DEFAULT_LEVEL, MZ_BEST_COMPRESSION.
+// The step is picked from the order-0 entropy of a sample of the block:
+// already compressed data (jpg, gz, ...) is close to 8 bits per byte and is
+// stored, text and logs are well below and get the better levels.
+// With a throughput target (-T), every block also measures how fast it was
+// compressed and moves all the following blocks one step down the ladder
+// when the threads together are slower than the target, one step up when
+// they are more than twice as fast.
+
+constexpr int LEVEL_STEPS = 4;
+constexpr int LEVEL_LADDER[LEVEL_STEPS] = {0, MZ_BEST_SPEED, MZ_DEFAULT_LEVEL,
+                                           MZ_BEST_COMPRESSION};
+
+// order-0 entropy in bits per byte of some slices spread over the block
+static inline double sampleEntropy(const unsigned char* ptr, size_t size)
+{
+    constexpr size_t slices = 8, slice = 1024;
+    uint32_t count[256] = {};
+    size_t total = 0;
+    if (size <= slices * slice)
+    {
+        for (size_t i = 0; i < size; i++)
+            count[ptr[i]]++;
+        total = size;
+    }
+    else
+    {
+        for (size_t s = 0; s < slices; s++)
+        {
+            const unsigned char* p = ptr + s * (size - slice) / (slices - 1);
+            for (size_t i = 0; i < slice; i++)
+                count[p[i]]++;
+        }
+        total = slices * slice;
+    }
+
+    double h = 0.0;
+    for (uint32_t c : count)
+        if (c > 0)
+        {
+            double p = double(c) / total;
+            h -= p * std::log2(p);
+        }
+    return h;
+}
+
+// the step of the ladder for a block of entropy h
+static inline int entropyStep(double h)
+{
+    if (h >= 7.5)
+        return 0;
+    if (h >= 6.0)
+        return 1;
+    if (h >= 4.0)
+        return 2;
+    return 3;
+}
+
+class LevelTuner
+{
+public:
+    // the level of the block of 'size' bytes pointed by 'ptr'
+    int choose(const unsigned char* ptr, size_t size) const
+    {
+        int step = entropyStep(sampleEntropy(ptr, size)) + m_bias.load();
+        return LEVEL_LADDER[std::clamp(step, 0, LEVEL_STEPS - 1)];
+    }
+
+    // a block of 'bytes' bytes took 'seconds' at 'level'
+    void update(int level, size_t bytes, double seconds)
+    {
+        m_blocks[level]++;
+        if (TARGET_MBS <= 0.0 || seconds <= 0.0)
+            return;
+
+        // all the threads are assumed to go as fast as this one
+        double mbs = bytes / seconds / 1e6 * NTHREADS;
+        int bias = m_bias.load();
+        if (mbs < TARGET_MBS && bias > -(LEVEL_STEPS - 1))
+            m_bias.compare_exchange_strong(bias, bias - 1);
+        else if (mbs > 2 * TARGET_MBS && bias < 0)
+            m_bias.compare_exchange_strong(bias, bias + 1);
+    }
+
+    // the number of blocks compressed at 'level'
+    uint64_t blocks(int level) const { return m_blocks[level].load(); }
+
+private:
+    std::atomic<int> m_bias{0}; // steps added to the one of the entropy
+    std::atomic<uint64_t> m_blocks[MZ_BEST_COMPRESSION + 1] = {};
+};
+
+static inline LevelTuner& levelTuner()
+{
+    static LevelTuner tuner;
+    return tuner;
+}
+
+#endif // _LEVEL_HPP
@@ -0,0 +1,87 @@
+/*
+ * miniz source code: https://github.com/richgel999/miniz
+ * https://code.google.com/archive/p/miniz/
+ *
+ * This is a reworked version of the example3.c file distributed with the
+ * miniz.c.
+ * --------------------
+ * example3.c - Demonstrates how to use miniz.c's deflate() and inflate()
+ * functions for simple file compression. Public domain, May 15 2011, Rich
+ * Geldreich, richgel99@gmail.com. See "unlicense" statement at the end of
+ * tinfl.c. For simplicity, this example is limited to files smaller than 4GB,
+ * but this is not a limitation of miniz.c.
+ * -------------------
+ *
+ */
+/* Author: Massimo Torquati <massimo.torquati@unipi.it>
+ * This code is a mix of POSIX C code and some C++ library call.
+ */
+
+#include <archive.hpp>
+#include <cmdline.hpp>
+#include <config.hpp>
+#include <dowork.hpp>
+#include <utility.hpp>
+#include <verify.hpp>
+#include <walker.hpp>
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        usage(argv[0]);
+        return -1;
+    }
+
+    // parse command line arguments and set some global variables
+    long start = parseCommandLine(argc, argv);
+    if (start < 0)
+        return -1;
+
+    auto t0 = std::chrono::steady_clock::now();
+    bool success = true;
+    while (argv[start])
+    {
+        size_t filesize = 0;
+        if (isDirectory(argv[start], filesize))
+            success &= COMP && (ARCHIVE || DICT_SIZE > 0)
+                           ? archiveDir(argv[start])
+                           : parallelWalk(argv[start], COMP);
+        else
+            success &= doWorkBlocks(argv[start], filesize, COMP);
+
+        start++;
+    }
+    if (VERIFY && QUITE_MODE >= 1)
+    {
+        const VerifyStats& v = verifyStats();
+        std::chrono::duration<double> t = std::chrono::steady_clock::now() - t0;
+        std::printf("verified %lu files, %.1f MB (%.1f MB inflated) in %.3f s, "
+                    "%.1f MB/s\n",
+                    (unsigned long)v.files.load(), v.cmpBytes / 1e6,
+                    v.rawBytes / 1e6, t.count(), v.cmpBytes / t.count() / 1e6);
+        std::printf("corrupted: %lu of %lu blocks, %lu files\n",
+                    (unsigned long)v.badBlocks.load(),
+                    (unsigned long)v.blocks.load(),
+                    (unsigned long)v.badFiles.load());
+    }
+    if (COMP && QUITE_MODE >= 2)
+    {
+        std::fprintf(stderr, "blocks per level:");
+        for (int l = 0; l <= MZ_BEST_COMPRESSION; l++)
+            if (levelTuner().blocks(l) > 0)
+                std::fprintf(stderr, " %d: %lu", l,
+                             (unsigned long)levelTuner().blocks(l));
+        std::fprintf(stderr, "\n");
+    }
+    // the standard output may carry an extracted range
+    std::FILE* msg = RANGE_LENGTH > 0 ? stderr : stdout;
+    if (!success)
+    {
+        std::fprintf(msg, "Exiting with (some) Error(s)\n");
+        return -1;
+    }
+    std::fprintf(msg, "Exiting with Success\n");
+
+    return 0;
+}
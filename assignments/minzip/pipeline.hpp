@@ -0,0 +1,275 @@
+#if !defined _PIPELINE_HPP
+#define _PIPELINE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <semaphore>
+#include <thread>
+#include <vector>
+
+#include <lock_queue.hpp>
+
+#include <config.hpp>
+#include <container.hpp>
+#include <pool.hpp>
+
+/*
+ * Pipelined compression of a file of more than one block (-p 1), the same
+ * schema of examples/spmcode9/ffc/ffc_farm.cpp with threads and queues in
+ * place of the FastFlow farm:
+ *
+ *               |---> Worker --->|
+ *               |                |
+ *   Reader ---> |---> Worker --->| --> Writer
+ *               |                |
+ *               |---> Worker --->|
+ *
+ * Reader: asks the kernel to read ahead the next blocks (readahead()), then
+ * reads the current one with pread() into a buffer of the pool.
+ * Worker: compresses a block into a buffer of the pool.
+ * Writer: puts the blocks back in order and appends them to the container,
+ * the block table is written at the end as in compressStream().
+ *
+ * So the disk reads while the workers compress and the writer writes. At
+ * most 4 * nthreads blocks are in flight, which bounds the memory whatever
+ * the size of the file. With -q 2 every stage reports how busy it was, its
+ * throughput and the depth of the queue in front of it, the busiest stage
+ * being the bottleneck.
+ */
+
+struct BlockTask
+{
+    size_t id;
+    unsigned char* raw;
+    unsigned char* cmp;
+};
+
+// counters of a stage, updated by all its threads
+struct StageStats
+{
+    std::atomic<uint64_t> busyNs{0}; // time spent doing the work
+    std::atomic<uint64_t> bytes{0};  // input bytes processed
+    std::atomic<uint64_t> depthSum{0}, depthMax{0}, samples{0};
+
+    // sample the depth of the queue in front of the stage
+    void sampleDepth(size_t depth)
+    {
+        depthSum += depth;
+        samples++;
+        uint64_t m = depthMax.load();
+        while (depth > m && !depthMax.compare_exchange_weak(m, depth))
+            ;
+    }
+};
+
+static inline void printStats(const char fname[], double seconds,
+                              size_t size, const char* names[],
+                              StageStats* stats, const int* threads, int n)
+{
+    std::fprintf(stderr, "%s: pipeline %.3f s, %.1f MB/s\n", fname, seconds,
+                 size / seconds / 1e6);
+    std::fprintf(stderr, "  %-9s %7s %9s %13s\n", "stage", "busy%",
+                 "MB/s", "queue avg/max");
+    int bottleneck = 0;
+    double maxBusy = 0.0;
+    for (int s = 0; s < n; s++)
+    {
+        // the busy time of a stage is shared by its threads
+        double busy = stats[s].busyNs * 1e-9 / threads[s];
+        char queue[32] = "-"; // the first stage has no queue in front
+        if (stats[s].samples > 0)
+            std::snprintf(queue, sizeof(queue), "%.1f/%lu",
+                          double(stats[s].depthSum) / stats[s].samples,
+                          (unsigned long)stats[s].depthMax.load());
+        std::fprintf(stderr, "  %-9s %7.1f %9.1f %13s\n", names[s],
+                     100.0 * busy / seconds,
+                     busy > 0.0 ? stats[s].bytes / busy / 1e6 : 0.0, queue);
+        if (busy > maxBusy)
+            maxBusy = busy, bottleneck = s;
+    }
+    std::fprintf(stderr, "  bottleneck: %s\n", names[bottleneck]);
+}
+
+// it compresses the file fname of size 'size' into fname + SUFFIX with the
+// Reader, nthreads Workers and the Writer
+// return true if okay, false in case of errors
+static inline bool compressPipeline(const char fname[], size_t size,
+                                    int nthreads = NTHREADS)
+{
+    using clock = std::chrono::steady_clock;
+    auto elapsed = [](clock::time_point t) -> uint64_t {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   clock::now() - t)
+            .count();
+    };
+
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0)
+    {
+        if (QUITE_MODE >= 1)
+        {
+            perror("open");
+            std::fprintf(stderr, "Failed opening file %s\n", fname);
+        }
+        return false;
+    }
+    std::string outfile = std::string(fname) + SUFFIX;
+    int out = open(outfile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (out < 0)
+    {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "Failed to open output file: %s\n",
+                         outfile.c_str());
+        close(fd);
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    const size_t nblocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    const size_t inflight = 4 * nthreads;
+    std::vector<BlockEntry> table(nblocks);
+    std::counting_semaphore<> slots(inflight);
+    spm::lock_queue<BlockTask> toWorkers(inflight), toWriter(inflight);
+    std::atomic<bool> error(false);
+    StageStats stats[3];
+    auto start = clock::now();
+
+    std::thread reader([&]() {
+        // keep the kernel reading about as much as can be in flight
+        const size_t ahead = inflight * BLOCK_SIZE;
+        for (size_t i = 0; i < nblocks && !error; i++)
+        {
+            slots.acquire();
+            BlockEntry& b = table[i];
+            b.rawOffset = i * BLOCK_SIZE;
+            b.rawSize = std::min(BLOCK_SIZE, size - b.rawOffset);
+            if (b.rawOffset % ahead == 0)
+                readahead(fd, b.rawOffset + ahead, ahead);
+
+            BlockTask t = {i, rawPool().get(), nullptr};
+            auto t0 = clock::now();
+            if (!readAt(fd, t.raw, b.rawSize, b.rawOffset))
+            {
+                if (QUITE_MODE >= 1)
+                    std::fprintf(stderr, "Failed to read block %zu of %s\n",
+                                 i, fname);
+                error = true;
+                rawPool().put(t.raw);
+                slots.release();
+                break;
+            }
+            stats[0].busyNs += elapsed(t0);
+            stats[0].bytes += b.rawSize;
+            stats[1].sampleDepth(toWorkers.size());
+            toWorkers.push(t);
+        }
+        toWorkers.close();
+    });
+
+    std::vector<std::thread> workers;
+    std::atomic<int> running(nthreads);
+    for (int w = 0; w < nthreads; w++)
+        workers.emplace_back([&]() {
+            std::optional<BlockTask> t;
+            while ((t = toWorkers.pop()).has_value())
+            {
+                BlockEntry& b = table[t->id];
+                auto t0 = clock::now();
+                t->cmp = cmpPool().get();
+                if (!compressBlock(t->raw, b, t->cmp))
+                {
+                    if (QUITE_MODE >= 1)
+                        std::fprintf(stderr,
+                                     "Failed to compress block %zu of %s\n",
+                                     t->id, fname);
+                    error = true;
+                }
+                rawPool().put(t->raw);
+                stats[1].busyNs += elapsed(t0);
+                stats[1].bytes += b.rawSize;
+                stats[2].sampleDepth(toWriter.size());
+                toWriter.push(*t);
+            }
+            // the last worker out closes the writer's queue
+            if (--running == 0)
+                toWriter.close();
+        });
+
+    std::thread writer([&]() {
+        // the blocks arrive out of order, at most 'inflight' ids apart
+        std::vector<std::optional<BlockTask>> pending(inflight);
+        size_t next = 0;
+        uint64_t offset =
+            sizeof(ContainerHeader) + nblocks * sizeof(BlockEntry);
+        std::optional<BlockTask> t;
+        while ((t = toWriter.pop()).has_value())
+        {
+            pending[t->id % inflight] = t;
+            while (pending[next % inflight].has_value())
+            {
+                BlockTask& r = *pending[next % inflight];
+                BlockEntry& b = table[r.id];
+                auto t0 = clock::now();
+                if (!error)
+                {
+                    b.cmpOffset = offset;
+                    if (!writeAt(out, r.cmp, b.cmpSize, offset))
+                    {
+                        if (QUITE_MODE >= 1)
+                            perror("pwrite");
+                        error = true;
+                    }
+                    offset += b.cmpSize;
+                }
+                stats[2].busyNs += elapsed(t0);
+                stats[2].bytes += b.rawSize;
+                cmpPool().put(r.cmp);
+                pending[next % inflight].reset();
+                slots.release();
+                next++;
+            }
+        }
+    });
+
+    reader.join();
+    for (std::thread& w : workers)
+        w.join();
+    writer.join();
+
+    if (!error)
+    {
+        ContainerHeader hdr = makeHeader(size, table);
+        if (!writeAt(out, reinterpret_cast<const unsigned char*>(&hdr),
+                     sizeof(hdr), 0) ||
+            !writeAt(out, reinterpret_cast<const unsigned char*>(table.data()),
+                     nblocks * sizeof(BlockEntry), sizeof(hdr)))
+        {
+            if (QUITE_MODE >= 1)
+                perror("pwrite");
+            error = true;
+        }
+    }
+    close(fd);
+    if (close(out) < 0)
+        error = true;
+
+    if (error)
+    {
+        unlink(outfile.c_str());
+        return false;
+    }
+    if (QUITE_MODE >= 2)
+    {
+        const char* names[] = {"read", "compress", "write"};
+        const int threads[] = {1, nthreads, 1};
+        std::chrono::duration<double> t = clock::now() - start;
+        printStats(fname, t.count(), size, names, stats, threads, 3);
+    }
+    if (REMOVE_ORIGIN)
+    {
+        unlink(fname);
+    }
+    return true;
+}
+
+#endif // _PIPELINE_HPP
@@ -0,0 +1,57 @@
+#if !defined _POOL_HPP
+#define _POOL_HPP
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// A pool of reusable buffers of the same size shared by the threads: a
+// buffer given back with put() is handed out again by the next get() instead
+// of going back to the allocator, so that compressing thousands of blocks
+// (or of small files) does not mean thousands of large new[]/delete[] and
+// page faults on fresh memory. The pool grows to the largest number of
+// buffers in use at the same time, and frees them when destroyed.
+class BufferPool
+{
+public:
+    explicit BufferPool(size_t bufSize) : m_bufSize(bufSize) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    ~BufferPool()
+    {
+        for (unsigned char* b : m_free)
+            delete[] b;
+    }
+
+    // size in bytes of every buffer
+    inline size_t bufSize() const { return m_bufSize; }
+
+    unsigned char* get()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_free.empty())
+            {
+                unsigned char* b = m_free.back();
+                m_free.pop_back();
+                return b;
+            }
+        }
+        return new unsigned char[m_bufSize];
+    }
+
+    void put(unsigned char* b)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free.push_back(b);
+    }
+
+private:
+    size_t m_bufSize;
+    std::mutex m_mutex;
+    std::vector<unsigned char*> m_free;
+};
+
+#endif // _POOL_HPP
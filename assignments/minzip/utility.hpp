@@ -120,6 +120,13 @@ static inline bool isdot(const char dir[])
 
     return false;
 }
+// true if name is exactly "." or ".."
+static inline bool isDotDir(const char name[])
+{
+    return name[0] == '.' &&
+           (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
 // returns true if 'p' is a directory, false if it is a file
 // if it is a regular file, filesize will containe the size of the regular file
 static inline bool isDirectory(const std::filesystem::path& p, size_t& filesize)
@@ -238,9 +245,24 @@ static inline bool compressData(unsigned char* ptr, size_t size,
 static inline bool decompressData(unsigned char* ptr, size_t size,
                                   const std::string& fname)
 {
+    if (size < sizeof(size_t))
+    {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "%s: truncated file\n", fname.c_str());
+        return false;
+    }
     size_t decompressedSize =
         reinterpret_cast<size_t*>(ptr)[0]; // read the original size
     ptr += sizeof(size_t);                 // advance the pointer
+    size -= sizeof(size_t);
+    const size_t expectedSize = decompressedSize;
+    // deflate cannot do better than about 1032:1, a larger size is garbage
+    if (decompressedSize / 1032 > size)
+    {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "%s: corrupted header\n", fname.c_str());
+        return false;
+    }
 
     // Write the decompressed data to a file
     unsigned char* decompressed_data = nullptr;
@@ -252,11 +274,14 @@ static inline bool decompressData(unsigned char* ptr, size_t size,
     if (!allocateFile(outfile.c_str(), decompressedSize, decompressed_data))
         return false;
     // decompress the data
-    if (uncompress(decompressed_data, &decompressedSize, ptr, size) != Z_OK)
+    // a truncated or corrupted stream fails or comes out short
+    if (uncompress(decompressed_data, &decompressedSize, ptr, size) != Z_OK ||
+        decompressedSize != expectedSize)
     {
         if (QUITE_MODE >= 1)
             std::fprintf(stderr, "uncompress failed!\n");
-        unmapFile(decompressed_data, decompressedSize);
+        unmapFile(decompressed_data, expectedSize);
+        unlink(outfile.c_str());
         return false;
     }
     // write the data into the disk
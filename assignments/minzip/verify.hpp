@@ -0,0 +1,171 @@
+#if !defined _VERIFY_HPP
+#define _VERIFY_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include <omp.h>
+
+#include <archive.hpp>
+#include <config.hpp>
+#include <container.hpp>
+#include <utility.hpp>
+
+// Integrity scan (--verify), nothing is written.
+//
+// Every block of the containers and of the archives is inflated into a
+// buffer of the thread and its CRC32, computed per block when compressing,
+// is compared with the one in the block table; the blocks of a file are
+// checked in parallel, and a directory is scanned by parallelWalk() as for
+// decompressing. The files written by minizseq have no block table: they
+// are inflated whole through a 32 KB window, checked by the Adler32 of
+// their zlib stream. The counters are shared by all the files of the scan.
+
+struct VerifyStats
+{
+    std::atomic<uint64_t> files{0}, badFiles{0};
+    std::atomic<uint64_t> blocks{0}, badBlocks{0};
+    std::atomic<uint64_t> cmpBytes{0}; // bytes of the files scanned
+    std::atomic<uint64_t> rawBytes{0}; // bytes inflated
+};
+
+static inline VerifyStats& verifyStats()
+{
+    static VerifyStats stats;
+    return stats;
+}
+
+// it inflates the blocks [0, nblocks) of the file fname in parallel with
+// inflate(i, buf), which inflates the block i into buf (a buffer of the
+// thread) and checks it, and reports the corrupted ones
+// return true if all of them are okay
+template <typename Inflate>
+static inline bool verifyBlocks(const std::string& fname, size_t nblocks,
+                                int nthreads, Inflate inflate)
+{
+    uint64_t bad = 0;
+#pragma omp parallel for schedule(dynamic) num_threads(nthreads)             \
+    reduction(+ : bad)
+    for (size_t i = 0; i < nblocks; i++)
+    {
+        thread_local std::vector<unsigned char> buf;
+        if (!inflate(i, buf))
+        {
+            if (QUITE_MODE >= 1)
+                std::fprintf(stderr, "%s: block %zu is corrupted\n",
+                             fname.c_str(), i);
+            bad++;
+        }
+    }
+    verifyStats().blocks += nblocks;
+    verifyStats().badBlocks += bad;
+    return bad == 0;
+}
+
+static inline bool verifyContainer(const unsigned char* ptr, size_t size,
+                                   const std::string& fname, int nthreads)
+{
+    ContainerHeader hdr;
+    const BlockEntry* table = nullptr;
+    if (!checkContainer(ptr, size, fname, hdr, table))
+        return false;
+    return verifyBlocks(
+        fname, hdr.nblocks, nthreads,
+        [&](size_t i, std::vector<unsigned char>& buf) {
+            const BlockEntry& b = table[i];
+            buf.resize(b.rawSize);
+            verifyStats().rawBytes += b.rawSize;
+            return inflateBlock(ptr, hdr, b, buf.data());
+        });
+}
+
+static inline bool verifyArchive(const unsigned char* ptr, size_t size,
+                                 const std::string& fname, int nthreads)
+{
+    ArchiveHeader hdr;
+    const MemberEntry* members = nullptr;
+    const BlockEntry* table = nullptr;
+    const char* names = nullptr;
+    const unsigned char* dict = nullptr;
+    if (!checkArchive(ptr, size, fname, hdr, members, table, names, dict))
+        return false;
+    return verifyBlocks(
+        fname, hdr.nblocks, nthreads,
+        [&](size_t i, std::vector<unsigned char>& buf) {
+            const BlockEntry& b = table[i];
+            buf.resize(b.rawSize);
+            verifyStats().rawBytes += b.rawSize;
+            return inflateArchiveBlock(ptr, hdr, dict, b, buf.data());
+        });
+}
+
+// a file of minizseq: the original size, then a zlib stream
+static inline bool verifyLegacy(const unsigned char* ptr, size_t size,
+                                const std::string& fname)
+{
+    verifyStats().blocks++;
+    size_t expected = 0;
+    if (size >= sizeof(size_t))
+        std::memcpy(&expected, ptr, sizeof(size_t));
+    if (size < sizeof(size_t) || expected / 1032 > size - sizeof(size_t))
+    {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "%s: corrupted header\n", fname.c_str());
+        verifyStats().badBlocks++;
+        return false;
+    }
+
+    // the output wraps around a window as large as the deflate one
+    std::vector<unsigned char> window(TINFL_LZ_DICT_SIZE);
+    tinfl_decompressor inflator;
+    tinfl_init(&inflator);
+    const unsigned char* in = ptr + sizeof(size_t);
+    size_t inLeft = size - sizeof(size_t), pos = 0, total = 0;
+    tinfl_status s;
+    do
+    {
+        size_t inBytes = inLeft, outBytes = window.size() - pos;
+        s = tinfl_decompress(&inflator, in, &inBytes, window.data(),
+                             window.data() + pos, &outBytes,
+                             TINFL_FLAG_PARSE_ZLIB_HEADER);
+        in += inBytes, inLeft -= inBytes;
+        pos = (pos + outBytes) % window.size();
+        total += outBytes;
+    } while (s == TINFL_STATUS_HAS_MORE_OUTPUT);
+    verifyStats().rawBytes += total;
+
+    if (s != TINFL_STATUS_DONE || total != expected)
+    {
+        if (QUITE_MODE >= 1)
+            std::fprintf(stderr, "%s: corrupted stream\n", fname.c_str());
+        verifyStats().badBlocks++;
+        return false;
+    }
+    return true;
+}
+
+// it verifies the file fname, mapped at 'ptr' and having size 'size',
+// whatever minzip wrote it
+// return true if it is okay, false if it is corrupted
+static inline bool verifyFile(const unsigned char* ptr, size_t size,
+                              const std::string& fname,
+                              int nthreads = NTHREADS)
+{
+    verifyStats().files++;
+    verifyStats().cmpBytes += size;
+    bool ok;
+    if (isContainer(ptr, size))
+        ok = verifyContainer(ptr, size, fname, nthreads);
+    else if (isArchive(ptr, size))
+        ok = verifyArchive(ptr, size, fname, nthreads);
+    else
+        ok = verifyLegacy(ptr, size, fname);
+    if (!ok)
+        verifyStats().badFiles++;
+    else if (QUITE_MODE >= 2)
+        std::fprintf(stderr, "%s: OK\n", fname.c_str());
+    return ok;
+}
+
+#endif // _VERIFY_HPP
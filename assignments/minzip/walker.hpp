@@ -0,0 +1,259 @@
+#if !defined _WALKER_HPP
+#define _WALKER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <lock_queue.hpp>
+
+#include <config.hpp>
+#include <dowork.hpp>
+#include <utility.hpp>
+
+// Parallel version of walkDir(), used by minizpar.
+//
+// A few scanner threads discover the files while NTHREADS workers compress
+// (or decompress) them. Every scanner owns a deque of directories still to
+// read: it takes them from the back (depth first), and when it runs out it
+// steals from the front of the others, where the directories closer to the
+// root, and likely with the largest subtrees, are; with nothing to steal it
+// sleeps until a directory is queued or the walk is over. The files found
+// become jobs in a bounded queue, so the scanners cannot run too far ahead of
+// the workers; the files smaller than SMALL_FILE are batched in a single job,
+// so that millions of tiny files do not mean millions of queue operations.
+//
+// Nothing calls chdir(): a directory is opened by its path once, its entries
+// are looked up with fstatat() relative to it, and the jobs carry the path
+// of the file from the current directory.
+//
+// A file of more than one block is not given to a single worker, it is
+// compressed at the end by the whole team as if it was on the command line.
+
+struct FileItem
+{
+    std::string name;
+    size_t size;
+};
+using Job = std::vector<FileItem>;
+
+// the directories still to scan of one scanner
+struct DirDeque
+{
+    std::mutex mutex;
+    std::deque<std::string> dirs;
+};
+
+// 'dname' is a directory; traverse it in parallel and compress (or
+// decompress) its files. The subdirectories are visited only with -r 1
+// returns false in case of error
+static inline bool parallelWalk(const char dname[], const bool comp)
+{
+    // scanning waits on the file system more than on the CPU
+    const int nscanners = std::max(1, NTHREADS / 2);
+    std::vector<DirDeque> deques(nscanners);
+    deques[0].dirs.push_back(dname);
+    std::atomic<size_t> pending(1); // directories found and not yet scanned
+    std::atomic<size_t> queued(1);  // directories waiting in the deques
+
+    // an idle scanner sleeps on 'idle' until 'queued' or 'pending' change;
+    // taking the mutex before notifying means no wake-up can be missed
+    // between its check and its wait
+    std::mutex idleMutex;
+    std::condition_variable idle;
+    auto wake = [&](bool all) {
+        {
+            std::lock_guard<std::mutex> lock(idleMutex);
+        }
+        if (all)
+            idle.notify_all();
+        else
+            idle.notify_one();
+    };
+
+    spm::lock_queue<Job> jobs(4 * NTHREADS);
+    std::mutex bigMutex;
+    std::vector<FileItem> big; // files of more than one block
+    std::atomic<bool> error(false);
+    std::atomic<size_t> nfiles(0), njobs(0);
+
+    // the next directory of scanner 'id', its own or stolen
+    auto next = [&](int id) -> std::optional<std::string> {
+        for (int k = 0; k < nscanners; k++)
+        {
+            DirDeque& d = deques[(id + k) % nscanners];
+            std::lock_guard<std::mutex> lock(d.mutex);
+            if (d.dirs.empty())
+                continue;
+            std::string dir;
+            if (k == 0)
+            {
+                dir = std::move(d.dirs.back());
+                d.dirs.pop_back();
+            }
+            else
+            {
+                dir = std::move(d.dirs.front());
+                d.dirs.pop_front();
+            }
+            queued--;
+            return dir;
+        }
+        return std::nullopt;
+    };
+
+    auto push = [&](Job&& job) {
+        nfiles += job.size();
+        njobs++;
+        jobs.push(std::move(job));
+    };
+
+    // reads the directory 'path', queuing its subdirectories in the deque of
+    // scanner 'id' and its files in the job queue (or in 'batch')
+    auto scan = [&](int id, const std::string& path, Job& batch,
+                    size_t& batchBytes) {
+        DIR* dir = opendir(path.c_str());
+        if (dir == NULL)
+        {
+            if (QUITE_MODE >= 1)
+            {
+                perror("opendir");
+                std::fprintf(stderr, "Error: opendir %s\n", path.c_str());
+            }
+            error = true;
+            return;
+        }
+        struct dirent* file;
+        while ((errno = 0, file = readdir(dir)) != NULL)
+        {
+            if (isDotDir(file->d_name))
+                continue;
+            struct stat statbuf;
+            if (fstatat(dirfd(dir), file->d_name, &statbuf, 0) == -1)
+            {
+                if (QUITE_MODE >= 1)
+                {
+                    perror("fstatat");
+                    std::fprintf(stderr, "Error: stat %s/%s\n", path.c_str(),
+                                 file->d_name);
+                }
+                error = true;
+                continue;
+            }
+            std::string name = path + "/" + file->d_name;
+            if (S_ISDIR(statbuf.st_mode))
+            {
+                if (RECUR)
+                {
+                    pending++;
+                    {
+                        std::lock_guard<std::mutex> lock(deques[id].mutex);
+                        deques[id].dirs.push_back(std::move(name));
+                    }
+                    queued++;
+                    wake(false);
+                }
+                continue;
+            }
+            if (!S_ISREG(statbuf.st_mode))
+                continue;
+            if (discardIt(file->d_name, comp))
+            {
+                if (QUITE_MODE >= 2)
+                    std::fprintf(stderr, "%s %s a %s suffix -- ignored\n",
+                                 name.c_str(),
+                                 comp ? "has already" : "does not have",
+                                 SUFFIX);
+                continue;
+            }
+
+            size_t size = statbuf.st_size;
+            if (size > BLOCK_SIZE)
+            {
+                std::lock_guard<std::mutex> lock(bigMutex);
+                big.push_back({std::move(name), size});
+            }
+            else if (size < SMALL_FILE)
+            {
+                batch.push_back({std::move(name), size});
+                batchBytes += size;
+                if (batch.size() >= BATCH_FILES || batchBytes >= BLOCK_SIZE)
+                {
+                    push(std::move(batch));
+                    batch = Job();
+                    batchBytes = 0;
+                }
+            }
+            else
+                push(Job{{std::move(name), size}});
+        }
+        if (errno != 0)
+        {
+            if (QUITE_MODE >= 1)
+                perror("readdir");
+            error = true;
+        }
+        closedir(dir);
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < NTHREADS; i++)
+        workers.emplace_back([&]() {
+            // the parallelism is among the files, one thread per file
+            std::optional<Job> job;
+            while ((job = jobs.pop()).has_value())
+                for (const FileItem& f : *job)
+                    if (!doWorkBlocks(f.name.c_str(), f.size, comp, 1))
+                        error = true;
+        });
+
+    std::vector<std::thread> scanners;
+    for (int i = 0; i < nscanners; i++)
+        scanners.emplace_back(
+            [&](int id) {
+                Job batch;
+                size_t batchBytes = 0;
+                while (pending.load() > 0)
+                {
+                    std::optional<std::string> dir = next(id);
+                    if (!dir.has_value())
+                    {
+                        // some other scanner may still find directories
+                        std::unique_lock<std::mutex> lock(idleMutex);
+                        idle.wait(lock, [&]() {
+                            return queued.load() > 0 || pending.load() == 0;
+                        });
+                        continue;
+                    }
+                    scan(id, *dir, batch, batchBytes);
+                    // the last directory lets all the sleepers go
+                    if (--pending == 0)
+                        wake(true);
+                }
+                if (!batch.empty())
+                    push(std::move(batch));
+            },
+            i);
+
+    for (std::thread& s : scanners)
+        s.join();
+    jobs.close();
+    for (std::thread& w : workers)
+        w.join();
+
+    if (QUITE_MODE >= 2)
+        std::fprintf(stderr, "%s: %zu files in %zu jobs, %zu large files\n",
+                     dname, nfiles.load(), njobs.load(), big.size());
+
+    for (const FileItem& f : big)
+        if (!doWorkBlocks(f.name.c_str(), f.size, comp))
+            error = true;
+
+    return !error;
+}
+
+#endif // _WALKER_HPP
@@ -8,8 +8,16 @@ if __name__ == "__main__":
     plain_df = {"elements": [], "time": []}
     auto_df = {"elements": [], "time": []}
     avx_df = {"elements": [], "time": []}
-
-    dfs = {"plain": plain_df, "auto": auto_df, "avx": avx_df}
+    online_df = {"elements": [], "time": []}
+    par_df = {"elements": [], "time": []}
+
+    dfs = {
+        "plain": plain_df,
+        "auto": auto_df,
+        "avx": avx_df,
+        "online": online_df,
+        "par": par_df,
+    }
 
     for i, path in enumerate(sys.argv):
         if i == 0:
@@ -29,7 +29,22 @@
   (this is the zlib license)
 */
 
+#ifndef AVX_MATHFUN_H
+#define AVX_MATHFUN_H
+
+/* GCC 12 warns on the self-initialized undefined vectors used inside the
+   AVX-512 intrinsics headers (PR 105593) */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
 #include <immintrin.h>
+#pragma GCC diagnostic pop
+
+/* the functions are compiled for AVX2 + FMA (and AVX-512 F below) whatever
+   the command line, so that a binary built for a generic x86-64 can call
+   them after checking the CPU at runtime */
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
 
 /* yes I know, the top of this file is quite ugly */
 #define ALIGN32_BEG
@@ -166,7 +181,7 @@ AVX2_INTOP_USING_SSE2(add_epi32)
 /* natural logarithm computed for 8 simultaneous float
    return NaN for x <= 0
 */
-v8sf log256_ps(v8sf x)
+inline v8sf log256_ps(v8sf x)
 {
     v8si imm0;
     v8sf one = *(v8sf *)_ps256_1;
@@ -253,7 +268,7 @@ _PS256_CONST(cephes_exp_p3, 4.1665795894E-2);
 _PS256_CONST(cephes_exp_p4, 1.6666665459E-1);
 _PS256_CONST(cephes_exp_p5, 5.0000001201E-1);
 
-v8sf exp256_ps(v8sf x)
+inline v8sf exp256_ps(v8sf x)
 {
     v8sf tmp = _mm256_setzero_ps(), fx;
     v8si imm0;
@@ -310,6 +325,220 @@ v8sf exp256_ps(v8sf x)
     return y;
 }
 
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+
+/* AVX-512 versions of exp256_ps and log256_ps, same cephes constants and
+   same accuracy, plus a family of faster exponentials of lower degree.
+   Every function has a _mask_ variant computing only the lanes selected by
+   k and copying the others from src, and a _maskz_ variant zeroing them, so
+   that the last K % 16 elements of an array are handled in-register. */
+
+typedef __m512 v16sf;  // vector of 16 float (avx512)
+typedef __m512i v16si; // vector of 16 int   (avx512)
+
+#define ALIGN64_END __attribute__((aligned(64)))
+
+#define _PS512_CONST(Name, Val)                                                \
+    static const float _ps512_##Name[16] ALIGN64_END = {                       \
+        Val, Val, Val, Val, Val, Val, Val, Val,                                \
+        Val, Val, Val, Val, Val, Val, Val, Val}
+#define _PI32_CONST512(Name, Val)                                              \
+    static const int _pi32_512_##Name[16] ALIGN64_END = {                     \
+        Val, Val, Val, Val, Val, Val, Val, Val,                                \
+        Val, Val, Val, Val, Val, Val, Val, Val}
+
+_PS512_CONST(1, 1.0f);
+_PS512_CONST(0p5, 0.5f);
+_PI32_CONST512(0x7f, 0x7f);
+_PI32_CONST512(min_norm_pos, 0x00800000);
+
+_PS512_CONST(exp_hi, 88.3762626647949f);
+_PS512_CONST(exp_lo, -88.3762626647949f);
+
+_PS512_CONST(cephes_LOG2EF, 1.44269504088896341);
+_PS512_CONST(cephes_exp_C1, 0.693359375);
+_PS512_CONST(cephes_exp_C2, -2.12194440e-4);
+
+_PS512_CONST(cephes_exp_p0, 1.9875691500E-4);
+_PS512_CONST(cephes_exp_p1, 1.3981999507E-3);
+_PS512_CONST(cephes_exp_p2, 8.3334519073E-3);
+_PS512_CONST(cephes_exp_p3, 4.1665795894E-2);
+_PS512_CONST(cephes_exp_p4, 1.6666665459E-1);
+_PS512_CONST(cephes_exp_p5, 5.0000001201E-1);
+
+_PS512_CONST(cephes_SQRTHF, 0.707106781186547524);
+_PS512_CONST(cephes_log_p0, 7.0376836292E-2);
+_PS512_CONST(cephes_log_p1, -1.1514610310E-1);
+_PS512_CONST(cephes_log_p2, 1.1676998740E-1);
+_PS512_CONST(cephes_log_p3, -1.2420140846E-1);
+_PS512_CONST(cephes_log_p4, +1.4249322787E-1);
+_PS512_CONST(cephes_log_p5, -1.6668057665E-1);
+_PS512_CONST(cephes_log_p6, +2.0000714765E-1);
+_PS512_CONST(cephes_log_p7, -2.4999993993E-1);
+_PS512_CONST(cephes_log_p8, +3.3333331174E-1);
+_PS512_CONST(cephes_log_q1, -2.12194440e-4);
+_PS512_CONST(cephes_log_q2, 0.693359375);
+
+inline v16sf exp512_mask_ps(v16sf src, __mmask16 k, v16sf x)
+{
+    v16sf one = *(v16sf *)_ps512_1;
+
+    x = _mm512_min_ps(x, *(v16sf *)_ps512_exp_hi);
+    x = _mm512_max_ps(x, *(v16sf *)_ps512_exp_lo);
+
+    /* express exp(x) as exp(g + n*log(2)), the floor is a single rounding */
+    v16sf fx = _mm512_fmadd_ps(x, *(v16sf *)_ps512_cephes_LOG2EF,
+                               *(v16sf *)_ps512_0p5);
+    fx = _mm512_roundscale_ps(fx, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+
+    x = _mm512_fnmadd_ps(fx, *(v16sf *)_ps512_cephes_exp_C1, x);
+    x = _mm512_fnmadd_ps(fx, *(v16sf *)_ps512_cephes_exp_C2, x);
+
+    v16sf z = _mm512_mul_ps(x, x);
+
+    v16sf y = *(v16sf *)_ps512_cephes_exp_p0;
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_exp_p1);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_exp_p2);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_exp_p3);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_exp_p4);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_exp_p5);
+    y = _mm512_fmadd_ps(y, z, x);
+    y = _mm512_add_ps(y, one);
+
+    /* build 2^n */
+    v16si imm0 = _mm512_cvttps_epi32(fx);
+    imm0 = _mm512_add_epi32(imm0, *(v16si *)_pi32_512_0x7f);
+    imm0 = _mm512_slli_epi32(imm0, 23);
+    v16sf pow2n = _mm512_castsi512_ps(imm0);
+    return _mm512_mask_mul_ps(src, k, y, pow2n);
+}
+
+inline v16sf exp512_ps(v16sf x) { return exp512_mask_ps(x, 0xffff, x); }
+
+inline v16sf exp512_maskz_ps(__mmask16 k, v16sf x)
+{
+    return exp512_mask_ps(_mm512_setzero_ps(), k, x);
+}
+
+/* minimax coefficients of exp(r) on [-log(2)/2, log(2)/2], row d - 3 holds
+   the polynomial of degree d. Max relative error in float:
+   3 -> 7.5e-5, 4 -> 2.7e-6, 5 -> 2.1e-7, 6 -> 9e-8 (cephes: 8e-8) */
+static const float exp512_poly_coeffs[4][7] = {
+    {9.999280735E-1, 1.000164186E+0, 5.049632642E-1, 1.656684235E-1},
+    {9.999992614E-1, 9.999634049E-1, 5.000435866E-1, 1.679090721E-1,
+     4.145860865E-2},
+    {1.000000072E+0, 9.999996920E-1, 4.999889485E-1, 1.666757473E-1,
+     4.191538198E-2, 8.297655198E-3},
+    {1.000000001E+0, 1.000000036E+0, 4.999999208E-1, 1.666642017E-1,
+     4.166822557E-2, 8.374815798E-3, 1.383684613E-3},
+};
+
+/* exp(x) with a polynomial of the given degree (3 to 6) instead of the
+   cephes one (7): n = round(x / log(2)) and 2^n is applied by scalef */
+template <int degree>
+v16sf exp512_poly_mask_ps(v16sf src, __mmask16 k, v16sf x)
+{
+    static_assert(degree >= 3 && degree <= 6, "degree must be in [3, 6]");
+    const float *c = exp512_poly_coeffs[degree - 3];
+
+    x = _mm512_min_ps(x, *(v16sf *)_ps512_exp_hi);
+    x = _mm512_max_ps(x, *(v16sf *)_ps512_exp_lo);
+
+    v16sf n = _mm512_roundscale_ps(
+        _mm512_mul_ps(x, *(v16sf *)_ps512_cephes_LOG2EF),
+        _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    x = _mm512_fnmadd_ps(n, *(v16sf *)_ps512_cephes_exp_C1, x);
+    x = _mm512_fnmadd_ps(n, *(v16sf *)_ps512_cephes_exp_C2, x);
+
+    v16sf y = _mm512_set1_ps(c[degree]);
+    for (int i = degree - 1; i >= 0; i--)
+        y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(c[i]));
+
+    return _mm512_mask_scalef_ps(src, k, y, n);
+}
+
+template <int degree>
+v16sf exp512_poly_ps(v16sf x)
+{
+    return exp512_poly_mask_ps<degree>(x, 0xffff, x);
+}
+
+template <int degree>
+v16sf exp512_poly_maskz_ps(__mmask16 k, v16sf x)
+{
+    return exp512_poly_mask_ps<degree>(_mm512_setzero_ps(), k, x);
+}
+
+/* the one used by softmax, whose error is dominated by the final sum */
+inline v16sf exp512_fast_ps(v16sf x) { return exp512_poly_ps<5>(x); }
+
+inline v16sf exp512_fast_mask_ps(v16sf src, __mmask16 k, v16sf x)
+{
+    return exp512_poly_mask_ps<5>(src, k, x);
+}
+
+inline v16sf exp512_fast_maskz_ps(__mmask16 k, v16sf x)
+{
+    return exp512_poly_mask_ps<5>(_mm512_setzero_ps(), k, x);
+}
+
+/* natural logarithm computed for 16 simultaneous float
+   return NaN for x <= 0
+*/
+inline v16sf log512_mask_ps(v16sf src, __mmask16 k, v16sf x)
+{
+    v16sf one = *(v16sf *)_ps512_1;
+
+    __mmask16 invalid = _mm512_cmp_ps_mask(x, _mm512_setzero_ps(), _CMP_LE_OS);
+
+    /* cut off denormalized stuff */
+    x = _mm512_max_ps(x, *(v16sf *)_pi32_512_min_norm_pos);
+
+    /* frexp: mantissa in [0.5, 1) and exponent */
+    v16sf e = _mm512_add_ps(_mm512_getexp_ps(x), one);
+    x = _mm512_getmant_ps(x, _MM_MANT_NORM_p5_1, _MM_MANT_SIGN_src);
+
+    /* if( x < SQRTHF ) { e -= 1; x = x + x - 1.0; } else { x = x - 1.0; } */
+    __mmask16 small =
+        _mm512_cmp_ps_mask(x, *(v16sf *)_ps512_cephes_SQRTHF, _CMP_LT_OS);
+    e = _mm512_mask_sub_ps(e, small, e, one);
+    x = _mm512_sub_ps(_mm512_mask_add_ps(x, small, x, x), one);
+
+    v16sf z = _mm512_mul_ps(x, x);
+
+    v16sf y = *(v16sf *)_ps512_cephes_log_p0;
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_log_p1);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_log_p2);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_log_p3);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_log_p4);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_log_p5);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_log_p6);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_log_p7);
+    y = _mm512_fmadd_ps(y, x, *(v16sf *)_ps512_cephes_log_p8);
+    y = _mm512_mul_ps(y, x);
+    y = _mm512_mul_ps(y, z);
+
+    y = _mm512_fmadd_ps(e, *(v16sf *)_ps512_cephes_log_q1, y);
+    y = _mm512_fnmadd_ps(z, *(v16sf *)_ps512_0p5, y);
+
+    x = _mm512_add_ps(x, y);
+    x = _mm512_fmadd_ps(e, *(v16sf *)_ps512_cephes_log_q2, x);
+
+    /* negative arg will be NAN */
+    x = _mm512_mask_mov_ps(x, invalid, _mm512_set1_ps(__builtin_nanf("")));
+    return _mm512_mask_mov_ps(src, k, x);
+}
+
+inline v16sf log512_ps(v16sf x) { return log512_mask_ps(x, 0xffff, x); }
+
+inline v16sf log512_maskz_ps(__mmask16 k, v16sf x)
+{
+    return log512_mask_ps(_mm512_setzero_ps(), k, x);
+}
+
+#pragma GCC pop_options /* avx512f */
+
 _PS256_CONST(minus_cephes_DP1, -0.78515625);
 _PS256_CONST(minus_cephes_DP2, -2.4187564849853515625e-4);
 _PS256_CONST(minus_cephes_DP3, -3.77489497744594108e-8);
@@ -333,7 +562,7 @@ _PS256_CONST(cephes_FOPI, 1.27323954473516); // 4 / M_PI
    surprising but correct result.
 
 */
-v8sf sin256_ps(v8sf x)
+inline v8sf sin256_ps(v8sf x)
 { // any x
     v8sf xmm1, xmm2 = _mm256_setzero_ps(), xmm3, sign_bit, y;
     v8si imm0, imm2;
@@ -461,7 +690,7 @@ v8sf sin256_ps(v8sf x)
 }
 
 /* almost the same as sin_ps */
-v8sf cos256_ps(v8sf x)
+inline v8sf cos256_ps(v8sf x)
 { // any x
     v8sf xmm1, xmm2 = _mm256_setzero_ps(), xmm3, y;
     v8si imm0, imm2;
@@ -580,7 +809,7 @@ v8sf cos256_ps(v8sf x)
 /* since sin256_ps and cos256_ps are almost identical, sincos256_ps could
    replace both of them.. it is almost as fast, and gives you a free cosine with
    your sine */
-void sincos256_ps(v8sf x, v8sf *s, v8sf *c)
+inline void sincos256_ps(v8sf x, v8sf *s, v8sf *c)
 {
     v8sf xmm1, xmm2, xmm3 = _mm256_setzero_ps(), sign_bit_sin, y;
     v8si imm0, imm2, imm4;
@@ -727,3 +956,7 @@ void sincos256_ps(v8sf x, v8sf *s, v8sf *c)
     *s = _mm256_xor_ps(xmm1, sign_bit_sin);
     *c = _mm256_xor_ps(xmm2, sign_bit_cos);
 }
+
+#pragma GCC pop_options /* avx2,fma */
+
+#endif /* AVX_MATHFUN_H */
@@ -0,0 +1,43 @@
+#ifndef HREDUCE_HPP
+#define HREDUCE_HPP
+
+#include "avx_mathfun.h"
+
+// horizontal reductions of an AVX vector, shared by the softmax kernels
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+inline float hmax256_ps(__m256 v)
+{
+    // reduce the vmax vector to 4 floats
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_max_ps(lo, hi);
+
+    __m128 shuf = _mm_movehdup_ps(lo);
+    lo = _mm_max_ps(lo, shuf);
+    shuf = _mm_movehl_ps(shuf, lo);
+    lo = _mm_max_ss(lo, shuf);
+
+    return _mm_cvtss_f32(lo);
+}
+
+inline float hsum256_ps(__m256 v)
+{
+    // reduce the vsum vector to 4 floats
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    lo = _mm_add_ps(lo, hi);
+
+    __m128 shuf = _mm_movehdup_ps(lo);
+    __m128 sums = _mm_add_ps(lo, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+
+    return _mm_cvtss_f32(sums);
+}
+
+#pragma GCC pop_options
+
+#endif
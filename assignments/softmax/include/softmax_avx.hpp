@@ -0,0 +1,231 @@
+#ifndef SOFTMAX_AVX_HPP
+#define SOFTMAX_AVX_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+#include "avx_mathfun.h"
+#include "hreduce.hpp"
+#include "isa.hpp"
+
+// Every pass has a version per ISA, compiled with its own target options: the
+// binary runs on any x86-64 and the widest version supported by the CPU is
+// chosen once at startup (SPM_ISA=scalar|sse|avx2|avx512 forces a narrower
+// one). There is no SSE exponential, that level reuses the scalar pass.
+
+inline float max_scalar(const float* input, size_t K)
+{
+    float max_val = -std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < K; i++)
+        max_val = std::max(max_val, input[i]);
+
+    return max_val;
+}
+
+inline float expsum_scalar(const float* input, float* output, size_t K,
+                           float max_val)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < K; i++)
+    {
+        output[i] = std::exp(input[i] - max_val);
+        sum += output[i];
+    }
+
+    return sum;
+}
+
+inline void div_scalar(float* output, size_t K, float sum)
+{
+    for (size_t i = 0; i < K; i++)
+        output[i] /= sum;
+}
+
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+
+inline float max_sse(const float* input, size_t K)
+{
+    int8_t carry = K % 4;
+
+    __m128 vmax = _mm_set1_ps(-std::numeric_limits<float>::infinity());
+    for (size_t i = 0; i < K - carry; i += 4)
+        vmax = _mm_max_ps(vmax, _mm_loadu_ps(&input[i]));
+
+    // reduce the vmax vector to 2 and then to 1 float
+    __m128 shuf = _mm_movehdup_ps(vmax);
+    vmax = _mm_max_ps(vmax, shuf);
+    shuf = _mm_movehl_ps(shuf, vmax);
+    vmax = _mm_max_ps(vmax, shuf);
+    float max_val = _mm_cvtss_f32(vmax);
+
+    // handle last elements sequentially
+    for (size_t i = K - carry; i < K; i++)
+        max_val = std::max(max_val, input[i]);
+
+    return max_val;
+}
+
+inline void div_sse(float* output, size_t K, float sum)
+{
+    int8_t carry = K % 4;
+    __m128 vsum = _mm_set1_ps(sum);
+    for (size_t i = 0; i < K - carry; i += 4)
+        _mm_storeu_ps(&output[i], _mm_div_ps(_mm_loadu_ps(&output[i]), vsum));
+
+    // handle last elements sequentially
+    for (size_t i = K - carry; i < K; ++i)
+        output[i] /= sum;
+}
+
+#pragma GCC target("avx2,fma")
+
+inline float max_avx(const float* input, size_t K)
+{
+    int8_t carry = K % 8;
+
+    // compute the max
+    __m256 vmax = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+    for (size_t i = 0; i < K - carry; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(&input[i]);
+        vmax = _mm256_max_ps(v, vmax);
+    }
+
+    // reduce the vmax vector to 4 floats
+    __m128 lo = _mm256_castps256_ps128(vmax);
+    __m128 hi = _mm256_extractf128_ps(vmax, 1);
+    lo = _mm_max_ps(lo, hi);
+
+    // reduce the lo vector to 2 floats
+    __m128 shuf = _mm_movehdup_ps(lo);
+    lo = _mm_max_ps(lo, shuf);
+
+    // extract the max from the last 2 elements
+    shuf = _mm_movehl_ps(shuf, lo);
+    lo = _mm_max_ps(lo, shuf);
+    float max_val = _mm_cvtss_f32(lo);
+
+    // handle last elements sequentially
+    for (size_t i = K - carry; i < K; i++)
+        max_val = std::max(max_val, input[i]);
+
+    return max_val;
+}
+
+inline float expsum_avx(const float* input, float* output, size_t K,
+                        float max_val)
+{
+    __m256 vsum = _mm256_setzero_ps();
+    __m256 vmax = _mm256_set1_ps(max_val);
+    int8_t carry = K % 8;
+    for (size_t i = 0; i < K - carry; i += 8)
+    {
+        __m256 vin = _mm256_loadu_ps(&input[i]);
+        __m256 e = exp256_ps(_mm256_sub_ps(vin, vmax));
+        _mm256_storeu_ps(&output[i], e);
+
+        vsum = _mm256_add_ps(vsum, e);
+    }
+
+    // horizontal sum of 8 elements vector
+    float sum = hsum256_ps(vsum);
+
+    // handle last elements sequentially
+    for (size_t i = K - carry; i < K; i++)
+    {
+        output[i] = std::exp(input[i] - max_val);
+        sum += output[i];
+    }
+
+    return sum;
+}
+
+inline void div_avx(float* output, size_t K, float sum)
+{
+    int8_t carry = K % 8;
+    __m256 vsum = _mm256_set1_ps(sum);
+    for (size_t i = 0; i < K - carry; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(&output[i]);
+        v = _mm256_div_ps(v, vsum);
+        _mm256_storeu_ps(&output[i], v);
+    }
+
+    // handle last elements sequentially
+    for (size_t i = K - carry; i < K; ++i)
+        output[i] /= sum;
+}
+
+#pragma GCC target("avx512f")
+
+inline float max_avx512(const float* input, size_t K)
+{
+    __m512 vmax = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+    for (size_t i = 0; i < K; i += 16)
+    {
+        __mmask16 m = (K - i >= 16) ? 0xffff : (1u << (K - i)) - 1;
+        vmax = _mm512_max_ps(vmax, _mm512_mask_loadu_ps(vmax, m, &input[i]));
+    }
+
+    return _mm512_reduce_max_ps(vmax);
+}
+
+inline float expsum_avx512(const float* input, float* output, size_t K,
+                           float max_val)
+{
+    __m512 vsum = _mm512_setzero_ps();
+    __m512 vmax = _mm512_set1_ps(max_val);
+    for (size_t i = 0; i < K; i += 16)
+    {
+        __mmask16 m = (K - i >= 16) ? 0xffff : (1u << (K - i)) - 1;
+        __m512 vin = _mm512_maskz_loadu_ps(m, &input[i]);
+        __m512 e = exp512_fast_maskz_ps(m, _mm512_sub_ps(vin, vmax));
+        _mm512_mask_storeu_ps(&output[i], m, e);
+
+        vsum = _mm512_add_ps(vsum, e);
+    }
+
+    return _mm512_reduce_add_ps(vsum);
+}
+
+inline void div_avx512(float* output, size_t K, float sum)
+{
+    __m512 vsum = _mm512_set1_ps(sum);
+    for (size_t i = 0; i < K; i += 16)
+    {
+        __mmask16 m = (K - i >= 16) ? 0xffff : (1u << (K - i)) - 1;
+        __m512 v = _mm512_maskz_loadu_ps(m, &output[i]);
+        _mm512_mask_storeu_ps(&output[i], m, _mm512_div_ps(v, vsum));
+    }
+}
+
+#pragma GCC pop_options
+
+using max_fn = float (*)(const float*, size_t);
+using expsum_fn = float (*)(const float*, float*, size_t, float);
+using div_fn = void (*)(float*, size_t, float);
+
+// kernels of the widest ISA available, chosen once at startup
+inline const max_fn max_kernel =
+    spm::dispatch<max_fn>(max_scalar, max_sse, max_avx, max_avx512);
+inline const expsum_fn expsum_kernel = spm::dispatch<expsum_fn>(
+    expsum_scalar, nullptr, expsum_avx, expsum_avx512);
+inline const div_fn div_kernel =
+    spm::dispatch<div_fn>(div_scalar, div_sse, div_avx, div_avx512);
+
+inline void softmax_avx(const float* input, float* output, size_t K)
+{
+    // Find the maximum to stabilize the computation of the exponential
+    float max_val = max_kernel(input, K);
+
+    // computes all exponentials with the shift of max_val and the total sum
+    float sum = expsum_kernel(input, output, K, max_val);
+
+    // normalize by dividing for the total sum
+    div_kernel(output, K, sum);
+}
+
+#endif
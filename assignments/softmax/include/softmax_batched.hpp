@@ -0,0 +1,167 @@
+#ifndef SOFTMAX_BATCHED_HPP
+#define SOFTMAX_BATCHED_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#include "avx_mathfun.h"
+#include "hreduce.hpp"
+#include "isa.hpp"
+
+// Row-wise softmax of a [rows x K] matrix stored with a leading dimension ld
+// (distance, in floats, between the starts of two rows). The rows are split
+// among a team of threads and every row is vectorized: a row is short enough
+// to stay in cache, so the three classic passes are kept and the last
+// partial vector of a row is handled with masked loads and stores.
+
+// below this many elements per thread the team costs more than it saves
+constexpr size_t batched_min_work = 1 << 14;
+
+inline void softmax_row_scalar(const float* input, float* output, size_t K)
+{
+    float max_val = -std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < K; i++)
+        max_val = std::max(max_val, input[i]);
+
+    float sum = 0.0f;
+    for (size_t i = 0; i < K; i++)
+    {
+        output[i] = std::exp(input[i] - max_val);
+        sum += output[i];
+    }
+
+    for (size_t i = 0; i < K; i++)
+        output[i] /= sum;
+}
+
+// the vector kernels are compiled for their own ISA and selected at runtime
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+// 8 ones followed by 8 zeros: loading from &ones[8 - n] enables n lanes
+alignas(32) static const int32_t tail_lanes[16] = {-1, -1, -1, -1, -1, -1,
+                                                   -1, -1, 0,  0,  0,  0,
+                                                   0,  0,  0,  0};
+
+inline void softmax_row_avx2(const float* input, float* output, size_t K)
+{
+    size_t carry = K % 8;
+    size_t body = K - carry;
+    __m256i m = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(&tail_lanes[8 - carry]));
+    __m256 vinf = _mm256_set1_ps(-std::numeric_limits<float>::infinity());
+
+    // compute the max, the disabled lanes of the tail read as -inf
+    __m256 vmax = vinf;
+    for (size_t i = 0; i < body; i += 8)
+        vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(&input[i]));
+    __m256 vtail = _mm256_blendv_ps(vinf, _mm256_maskload_ps(&input[body], m),
+                                    _mm256_castsi256_ps(m));
+    vmax = _mm256_set1_ps(hmax256_ps(_mm256_max_ps(vmax, vtail)));
+
+    // exponentials and their sum, the disabled lanes add zero
+    __m256 vsum = _mm256_setzero_ps();
+    for (size_t i = 0; i < body; i += 8)
+    {
+        __m256 e = exp256_ps(_mm256_sub_ps(_mm256_loadu_ps(&input[i]), vmax));
+        _mm256_storeu_ps(&output[i], e);
+        vsum = _mm256_add_ps(vsum, e);
+    }
+    __m256 e = exp256_ps(_mm256_sub_ps(vtail, vmax));
+    e = _mm256_and_ps(e, _mm256_castsi256_ps(m));
+    _mm256_maskstore_ps(&output[body], m, e);
+    vsum = _mm256_add_ps(vsum, e);
+
+    // normalize
+    __m256 vinv = _mm256_set1_ps(1.0f / hsum256_ps(vsum));
+    for (size_t i = 0; i < body; i += 8)
+        _mm256_storeu_ps(&output[i],
+                         _mm256_mul_ps(_mm256_loadu_ps(&output[i]), vinv));
+    _mm256_maskstore_ps(&output[body], m, _mm256_mul_ps(e, vinv));
+}
+
+#pragma GCC target("avx512f")
+
+inline void softmax_row_avx512(const float* input, float* output, size_t K)
+{
+    size_t carry = K % 16;
+    size_t body = K - carry;
+    __mmask16 m = (1u << carry) - 1;
+    __m512 vinf = _mm512_set1_ps(-std::numeric_limits<float>::infinity());
+
+    // compute the max, the disabled lanes of the tail read as -inf
+    __m512 vmax = vinf;
+    for (size_t i = 0; i < body; i += 16)
+        vmax = _mm512_max_ps(vmax, _mm512_loadu_ps(&input[i]));
+    __m512 vtail = _mm512_mask_loadu_ps(vinf, m, &input[body]);
+    vmax = _mm512_set1_ps(_mm512_reduce_max_ps(_mm512_max_ps(vmax, vtail)));
+
+    // exponentials and their sum, the disabled lanes add zero
+    __m512 vsum = _mm512_setzero_ps();
+    for (size_t i = 0; i < body; i += 16)
+    {
+        __m512 e =
+            exp512_fast_ps(_mm512_sub_ps(_mm512_loadu_ps(&input[i]), vmax));
+        _mm512_storeu_ps(&output[i], e);
+        vsum = _mm512_add_ps(vsum, e);
+    }
+    __m512 e = exp512_fast_maskz_ps(m, _mm512_sub_ps(vtail, vmax));
+    vsum = _mm512_add_ps(vsum, e);
+
+    // normalize
+    __m512 vinv = _mm512_set1_ps(1.0f / _mm512_reduce_add_ps(vsum));
+    for (size_t i = 0; i < body; i += 16)
+        _mm512_storeu_ps(&output[i],
+                         _mm512_mul_ps(_mm512_loadu_ps(&output[i]), vinv));
+    _mm512_mask_storeu_ps(&output[body], m, _mm512_mul_ps(e, vinv));
+}
+
+#pragma GCC pop_options
+
+using softmax_row_fn = void (*)(const float*, float*, size_t);
+
+// kernel of the widest ISA available, chosen once at startup
+inline const softmax_row_fn softmax_row = spm::dispatch<softmax_row_fn>(
+    softmax_row_scalar, nullptr, softmax_row_avx2, softmax_row_avx512);
+
+/**
+ * @brief softmax of every row of the [rows x K] matrix `in`, written to the
+ * matching row of `out`. Both matrices have leading dimension `ld` >= K.
+ * @param threads size of the team, 0 to use every hardware thread. The
+ * calling thread is part of the team.
+ */
+inline void softmax_batched(const float* in, float* out, size_t rows, size_t K,
+                            size_t ld, size_t threads = 0)
+{
+    // no team, and no division by its size, for an empty matrix
+    if (rows == 0)
+        return;
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, rows);
+    threads = std::min(threads,
+                       std::max<size_t>(1, rows * K / batched_min_work));
+
+    // rows have all the same cost, so a static block partition is balanced
+    auto work = [&](size_t id) {
+        size_t begin = rows * id / threads;
+        size_t end = rows * (id + 1) / threads;
+        for (size_t r = begin; r < end; r++)
+            softmax_row(&in[r * ld], &out[r * ld], K);
+    };
+
+    std::vector<std::thread> team;
+    team.reserve(threads - 1);
+    for (size_t id = 1; id < threads; id++)
+        team.emplace_back(work, id);
+    work(0);
+
+    for (auto& t : team)
+        t.join();
+}
+
+#endif
@@ -0,0 +1,399 @@
+#ifndef SOFTMAX_MIXED_HPP
+#define SOFTMAX_MIXED_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "softmax_online.hpp"
+
+// Mixed precision softmax: the input is read as bf16, fp16 or fp32, every
+// sum is accumulated in fp32 and the output is written in the precision the
+// caller asks for. The input is converted a tile at a time into a buffer
+// that stays in L1 and the tile goes through the fp32 online kernels, so
+// the memory traffic is the one of the narrow type.
+
+/**
+ * @brief bfloat16 and IEEE half, stored as their raw bits.
+ */
+struct bf16
+{
+    uint16_t bits;
+};
+
+struct fp16
+{
+    uint16_t bits;
+};
+
+// elements converted at a time, 8 KB of fp32
+constexpr size_t mixed_tile = 2048;
+
+// emulated conversions, round to nearest even
+
+inline float to_float(bf16 h)
+{
+    uint32_t x = uint32_t(h.bits) << 16;
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+inline float to_float(fp16 h)
+{
+    uint32_t sign = uint32_t(h.bits & 0x8000) << 16;
+    uint32_t exp = (h.bits >> 10) & 0x1f;
+    uint32_t mant = h.bits & 0x3ff;
+
+    uint32_t x;
+    if (exp == 0x1f) // inf or nan
+        x = sign | 0x7f800000 | (mant << 13);
+    else if (exp != 0)
+        x = sign | ((exp + 112) << 23) | (mant << 13);
+    else if (mant == 0)
+        x = sign;
+    else
+    {
+        // subnormal half, normal float
+        int e = -1;
+        do
+        {
+            e++;
+            mant <<= 1;
+        } while ((mant & 0x400) == 0);
+        x = sign | ((112 - e) << 23) | ((mant & 0x3ff) << 13);
+    }
+
+    float f;
+    std::memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+inline bf16 to_bf16(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7fffffff) > 0x7f800000) // keep nan quiet
+        return {uint16_t((x >> 16) | 0x40)};
+
+    x += 0x7fff + ((x >> 16) & 1);
+    return {uint16_t(x >> 16)};
+}
+
+inline fp16 to_fp16(float f)
+{
+    uint32_t x;
+    std::memcpy(&x, &f, sizeof(x));
+    uint16_t sign = (x >> 16) & 0x8000;
+    x &= 0x7fffffff;
+
+    if (x >= 0x7f800000) // inf or nan
+        return {uint16_t(sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0))};
+    if (x >= 0x477ff000) // rounds above 65504
+        return {uint16_t(sign | 0x7c00)};
+    if (x < 0x33000000) // rounds to zero
+        return {sign};
+
+    if (x < 0x38800000)
+    {
+        // subnormal half: m * 2^(e - 150) in units of 2^-24
+        uint32_t e = x >> 23;
+        uint32_t m = (x & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - e;
+        uint32_t r = m >> shift;
+        uint32_t rem = m & ((1u << shift) - 1);
+        uint32_t half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (r & 1)))
+            r++;
+        return {uint16_t(sign | r)};
+    }
+
+    // rebias the exponent from 127 to 15, a carry of the rounding moves
+    // into the exponent as it should
+    x += 0xfff + ((x >> 13) & 1);
+    return {uint16_t(sign | ((x - 0x38000000) >> 13))};
+}
+
+template <typename T>
+void to_float_scalar(const T* input, float* output, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        output[i] = to_float(input[i]);
+}
+
+inline void to_bf16_scalar(const float* input, bf16* output, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        output[i] = to_bf16(input[i]);
+}
+
+inline void to_fp16_scalar(const float* input, fp16* output, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        output[i] = to_fp16(input[i]);
+}
+
+// the vector conversions are compiled for their own ISA and selected at
+// runtime, the avx2 level includes F16C
+#pragma GCC push_options
+#pragma GCC target("avx2,fma,f16c")
+
+inline void bf16_to_float_avx2(const bf16* input, float* output, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&input[i]));
+        __m256i x = _mm256_slli_epi32(_mm256_cvtepu16_epi32(h), 16);
+        _mm256_storeu_ps(&output[i], _mm256_castsi256_ps(x));
+    }
+
+    // handle last elements sequentially
+    for (; i < n; i++)
+        output[i] = to_float(input[i]);
+}
+
+inline void fp16_to_float_avx2(const fp16* input, float* output, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&input[i]));
+        _mm256_storeu_ps(&output[i], _mm256_cvtph_ps(h));
+    }
+
+    // handle last elements sequentially
+    for (; i < n; i++)
+        output[i] = to_float(input[i]);
+}
+
+inline void to_bf16_avx2(const float* input, bf16* output, size_t n)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i bias = _mm256_set1_epi32(0x7fff);
+    const __m256i quiet = _mm256_set1_epi32(0x40);
+
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v = _mm256_loadu_ps(&input[i]);
+        __m256i x = _mm256_castps_si256(v);
+
+        // same rounding as to_bf16
+        __m256i lsb = _mm256_and_si256(_mm256_srli_epi32(x, 16), one);
+        __m256i r = _mm256_add_epi32(x, _mm256_add_epi32(bias, lsb));
+        r = _mm256_srli_epi32(r, 16);
+        __m256i nan = _mm256_or_si256(_mm256_srli_epi32(x, 16), quiet);
+        r = _mm256_blendv_epi8(
+            r, nan, _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q)));
+
+        __m128i h = _mm_packus_epi32(_mm256_castsi256_si128(r),
+                                     _mm256_extracti128_si256(r, 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[i]), h);
+    }
+
+    // handle last elements sequentially
+    for (; i < n; i++)
+        output[i] = to_bf16(input[i]);
+}
+
+inline void to_fp16_avx2(const float* input, fp16* output, size_t n)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(&input[i]),
+                                    _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&output[i]), h);
+    }
+
+    // handle last elements sequentially
+    for (; i < n; i++)
+        output[i] = to_fp16(input[i]);
+}
+
+#pragma GCC target("avx512f")
+
+// AVX-512 F has no masked 16 bits load, the tail goes through a register
+// cleared beforehand
+inline __m256i load_epi16(const void* p, size_t n)
+{
+    if (n == 16)
+        return _mm256_loadu_si256(static_cast<const __m256i*>(p));
+
+    __m256i v = _mm256_setzero_si256();
+    std::memcpy(&v, p, n * sizeof(uint16_t));
+    return v;
+}
+
+inline void bf16_to_float_avx512(const bf16* input, float* output, size_t n)
+{
+    for (size_t i = 0; i < n; i += 16)
+    {
+        size_t left = std::min<size_t>(n - i, 16);
+        __mmask16 m = (1u << left) - 1;
+        __m512i x = _mm512_cvtepu16_epi32(load_epi16(&input[i], left));
+        x = _mm512_slli_epi32(x, 16);
+        _mm512_mask_storeu_ps(&output[i], m, _mm512_castsi512_ps(x));
+    }
+}
+
+inline void fp16_to_float_avx512(const fp16* input, float* output, size_t n)
+{
+    for (size_t i = 0; i < n; i += 16)
+    {
+        size_t left = std::min<size_t>(n - i, 16);
+        __mmask16 m = (1u << left) - 1;
+        __m256i h = load_epi16(&input[i], left);
+        _mm512_mask_storeu_ps(&output[i], m, _mm512_cvtph_ps(h));
+    }
+}
+
+inline void to_bf16_avx512(const float* input, bf16* output, size_t n)
+{
+    const __m512i one = _mm512_set1_epi32(1);
+    const __m512i bias = _mm512_set1_epi32(0x7fff);
+    const __m512i quiet = _mm512_set1_epi32(0x40);
+
+    for (size_t i = 0; i < n; i += 16)
+    {
+        size_t left = std::min<size_t>(n - i, 16);
+        __mmask16 m = (1u << left) - 1;
+        __m512 v = _mm512_maskz_loadu_ps(m, &input[i]);
+        __m512i x = _mm512_castps_si512(v);
+
+        // same rounding as to_bf16
+        __m512i lsb = _mm512_and_si512(_mm512_srli_epi32(x, 16), one);
+        __m512i r = _mm512_add_epi32(x, _mm512_add_epi32(bias, lsb));
+        r = _mm512_srli_epi32(r, 16);
+        __mmask16 nan = _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q);
+        r = _mm512_mask_or_epi32(r, nan, _mm512_srli_epi32(x, 16), quiet);
+
+        _mm512_mask_cvtepi32_storeu_epi16(&output[i], m, r);
+    }
+}
+
+inline void to_fp16_avx512(const float* input, fp16* output, size_t n)
+{
+    for (size_t i = 0; i < n; i += 16)
+    {
+        size_t left = std::min<size_t>(n - i, 16);
+        __mmask16 m = (1u << left) - 1;
+        __m256i h = _mm512_cvtps_ph(_mm512_maskz_loadu_ps(m, &input[i]),
+                                    _MM_FROUND_TO_NEAREST_INT |
+                                        _MM_FROUND_NO_EXC);
+        _mm512_mask_cvtepi32_storeu_epi16(&output[i], m,
+                                          _mm512_cvtepu16_epi32(h));
+    }
+}
+
+#pragma GCC target("avx512bf16")
+
+// native round to nearest even, subnormal results are flushed to zero
+inline void to_bf16_avx512bf16(const float* input, bf16* output, size_t n)
+{
+    for (size_t i = 0; i < n; i += 16)
+    {
+        size_t left = std::min<size_t>(n - i, 16);
+        __mmask16 m = (1u << left) - 1;
+        __m256bh h = _mm512_cvtneps_pbh(_mm512_maskz_loadu_ps(m, &input[i]));
+        _mm512_mask_cvtepi32_storeu_epi16(
+            &output[i], m, _mm512_cvtepu16_epi32(reinterpret_cast<__m256i&>(h)));
+    }
+}
+
+#pragma GCC pop_options
+
+template <typename T>
+using to_float_fn = void (*)(const T*, float*, size_t);
+template <typename T>
+using from_float_fn = void (*)(const float*, T*, size_t);
+
+// conversions of the widest ISA available, chosen once at startup
+inline const to_float_fn<bf16> bf16_to_float = spm::dispatch<to_float_fn<bf16>>(
+    to_float_scalar<bf16>, nullptr, bf16_to_float_avx2, bf16_to_float_avx512);
+inline const to_float_fn<fp16> fp16_to_float = spm::dispatch<to_float_fn<fp16>>(
+    to_float_scalar<fp16>, nullptr, fp16_to_float_avx2, fp16_to_float_avx512);
+inline const from_float_fn<fp16> float_to_fp16 =
+    spm::dispatch<from_float_fn<fp16>>(to_fp16_scalar, nullptr, to_fp16_avx2,
+                                       to_fp16_avx512);
+
+// AVX-512 BF16 is an extension of its own, not implied by the avx512 level
+inline const from_float_fn<bf16> float_to_bf16 =
+    spm::selected_isa() == spm::isa::avx512 &&
+            __builtin_cpu_supports("avx512bf16")
+        ? to_bf16_avx512bf16
+        : spm::dispatch<from_float_fn<bf16>>(to_bf16_scalar, nullptr,
+                                             to_bf16_avx2, to_bf16_avx512);
+
+// a tile of fp32 values: the input itself when it is already fp32
+inline const float* load_tile(const float* input, float*, size_t)
+{
+    return input;
+}
+
+inline const float* load_tile(const bf16* input, float* tile, size_t n)
+{
+    bf16_to_float(input, tile, n);
+    return tile;
+}
+
+inline const float* load_tile(const fp16* input, float* tile, size_t n)
+{
+    fp16_to_float(input, tile, n);
+    return tile;
+}
+
+// where a tile of results is written: fp32 results go straight to the output
+inline float* result_tile(float* output, float*) { return output; }
+
+template <typename T>
+float* result_tile(T*, float* tile)
+{
+    return tile;
+}
+
+inline void store_tile(const float*, float*, size_t) {}
+
+inline void store_tile(const float* tile, bf16* output, size_t n)
+{
+    float_to_bf16(tile, output, n);
+}
+
+inline void store_tile(const float* tile, fp16* output, size_t n)
+{
+    float_to_fp16(tile, output, n);
+}
+
+/**
+ * @brief softmax of K values of type In (bf16, fp16 or float) written as
+ * type Out (bf16, fp16 or float). Max, sums and exponentials are fp32.
+ */
+template <typename In, typename Out>
+void softmax_mixed(const In* input, Out* output, size_t K)
+{
+    alignas(64) float tile[mixed_tile];
+
+    // the (max, sum) pairs of the tiles are merged as they come
+    float max_val = -std::numeric_limits<float>::infinity();
+    float sum = 0.0f;
+    for (size_t i = 0; i < K; i += mixed_tile)
+    {
+        size_t n = std::min(mixed_tile, K - i);
+        float m, s;
+        maxsum(load_tile(&input[i], tile, n), n, m, s);
+        online_merge(m, s, max_val, sum);
+    }
+
+    // the tile can be both the source and the destination of normalize
+    for (size_t i = 0; i < K; i += mixed_tile)
+    {
+        size_t n = std::min(mixed_tile, K - i);
+        float* result = result_tile(&output[i], tile);
+        normalize(load_tile(&input[i], tile, n), result, n, max_val, sum);
+        store_tile(result, &output[i], n);
+    }
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef SOFTMAX_ONLINE_HPP
+#define SOFTMAX_ONLINE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+#include "avx_mathfun.h"
+#include "hreduce.hpp"
+#include "isa.hpp"
+
+// Online softmax: the first pass keeps, for every lane, the running max and
+// the sum of exp(x - max), rescaling the sum by exp(old_max - new_max) only
+// when the max of some lane grows. The second pass writes
+// exp(x - max) / sum. Against the three passes of softmax_avx the input is
+// read twice instead of three times and the output written once.
+
+// adds x to the running (max, sum) pair
+inline void online_update(float x, float& max_val, float& sum)
+{
+    if (x > max_val)
+    {
+        sum *= std::exp(max_val - x);
+        max_val = x;
+    }
+
+    // -inf adds nothing, and -inf - max_val is a NaN while max_val is -inf
+    if (x != -std::numeric_limits<float>::infinity())
+        sum += std::exp(x - max_val);
+}
+
+inline void maxsum_scalar(const float* input, size_t K, float& max_val,
+                          float& sum)
+{
+    max_val = -std::numeric_limits<float>::infinity();
+    sum = 0.0f;
+    for (size_t i = 0; i < K; i++)
+        online_update(input[i], max_val, sum);
+}
+
+inline void normalize_scalar(const float* input, float* output, size_t K,
+                             float max_val, float sum)
+{
+    for (size_t i = 0; i < K; i++)
+        output[i] = std::exp(input[i] - max_val) / sum;
+}
+
+// the vector kernels are compiled for their own ISA and selected at runtime
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+
+inline void maxsum_avx2(const float* input, size_t K, float& max_val,
+                        float& sum)
+{
+    size_t carry = K % 8;
+    max_val = -std::numeric_limits<float>::infinity();
+    sum = 0.0f;
+
+    if (K >= 8)
+    {
+        // the lanes start from -FLT_MAX instead of -inf: a -inf input would
+        // compute exp(-inf - -inf), a NaN, where it must add (almost) zero
+        __m256 vmax = _mm256_max_ps(
+            _mm256_loadu_ps(&input[0]),
+            _mm256_set1_ps(-std::numeric_limits<float>::max()));
+        __m256 vsum = _mm256_setzero_ps();
+        for (size_t i = 0; i < K - carry; i += 8)
+        {
+            __m256 v = _mm256_loadu_ps(&input[i]);
+
+            // once the max has settled this branch is almost never taken
+            __m256 grow = _mm256_cmp_ps(v, vmax, _CMP_GT_OQ);
+            if (_mm256_movemask_ps(grow) != 0)
+            {
+                __m256 vnew = _mm256_max_ps(vmax, v);
+                vsum = _mm256_mul_ps(vsum,
+                                     exp256_ps(_mm256_sub_ps(vmax, vnew)));
+                vmax = vnew;
+            }
+
+            vsum = _mm256_add_ps(vsum, exp256_ps(_mm256_sub_ps(v, vmax)));
+        }
+
+        // bring every lane to the global max before summing them
+        max_val = hmax256_ps(vmax);
+        vsum = _mm256_mul_ps(
+            vsum, exp256_ps(_mm256_sub_ps(vmax, _mm256_set1_ps(max_val))));
+        sum = hsum256_ps(vsum);
+    }
+
+    // handle last elements sequentially
+    for (size_t i = K - carry; i < K; i++)
+        online_update(input[i], max_val, sum);
+}
+
+inline void normalize_avx2(const float* input, float* output, size_t K,
+                           float max_val, float sum)
+{
+    size_t carry = K % 8;
+    __m256 vmax = _mm256_set1_ps(max_val);
+    __m256 vinv = _mm256_set1_ps(1.0f / sum);
+    for (size_t i = 0; i < K - carry; i += 8)
+    {
+        __m256 v = exp256_ps(_mm256_sub_ps(_mm256_loadu_ps(&input[i]), vmax));
+        _mm256_storeu_ps(&output[i], _mm256_mul_ps(v, vinv));
+    }
+
+    // handle last elements sequentially
+    for (size_t i = K - carry; i < K; i++)
+        output[i] = std::exp(input[i] - max_val) / sum;
+}
+
+#pragma GCC target("avx512f")
+
+// the tail is loaded under a mask, so AVX-512 needs no sequential loop
+inline void maxsum_avx512(const float* input, size_t K, float& max_val,
+                          float& sum)
+{
+    max_val = -std::numeric_limits<float>::infinity();
+    sum = 0.0f;
+    if (K == 0)
+        return;
+
+    // -FLT_MAX instead of -inf, see maxsum_avx2
+    __m512 vmax = _mm512_set1_ps(-std::numeric_limits<float>::max());
+    __m512 vsum = _mm512_setzero_ps();
+    for (size_t i = 0; i < K; i += 16)
+    {
+        __mmask16 m = (K - i >= 16) ? 0xffff : (1u << (K - i)) - 1;
+
+        // the lanes out of the tail keep their max and add nothing
+        __m512 v = _mm512_mask_loadu_ps(vmax, m, &input[i]);
+        __mmask16 grow = _mm512_cmp_ps_mask(v, vmax, _CMP_GT_OQ);
+        if (grow != 0)
+        {
+            __m512 vnew = _mm512_max_ps(vmax, v);
+            __m512 scale = exp512_fast_ps(_mm512_sub_ps(vmax, vnew));
+            vsum = _mm512_mask_mul_ps(vsum, grow, vsum, scale);
+            vmax = vnew;
+        }
+
+        vsum = _mm512_add_ps(
+            vsum, exp512_fast_maskz_ps(m, _mm512_sub_ps(v, vmax)));
+    }
+
+    // bring every lane to the global max before summing them, the lanes
+    // never reached (K < 16) are still at -FLT_MAX with a zero sum
+    max_val = _mm512_reduce_max_ps(vmax);
+    vsum = _mm512_mul_ps(
+        vsum, exp512_fast_ps(_mm512_sub_ps(vmax, _mm512_set1_ps(max_val))));
+    sum = _mm512_reduce_add_ps(vsum);
+}
+
+inline void normalize_avx512(const float* input, float* output, size_t K,
+                             float max_val, float sum)
+{
+    __m512 vmax = _mm512_set1_ps(max_val);
+    __m512 vinv = _mm512_set1_ps(1.0f / sum);
+    for (size_t i = 0; i < K; i += 16)
+    {
+        __mmask16 m = (K - i >= 16) ? 0xffff : (1u << (K - i)) - 1;
+        __m512 v = _mm512_maskz_loadu_ps(m, &input[i]);
+        v = exp512_fast_ps(_mm512_sub_ps(v, vmax));
+        _mm512_mask_storeu_ps(&output[i], m, _mm512_mul_ps(v, vinv));
+    }
+}
+
+#pragma GCC pop_options
+
+using maxsum_fn = void (*)(const float*, size_t, float&, float&);
+using normalize_fn = void (*)(const float*, float*, size_t, float, float);
+
+// kernels of the widest ISA available, chosen once at startup
+inline const maxsum_fn maxsum = spm::dispatch<maxsum_fn>(
+    maxsum_scalar, nullptr, maxsum_avx2, maxsum_avx512);
+inline const normalize_fn normalize = spm::dispatch<normalize_fn>(
+    normalize_scalar, nullptr, normalize_avx2, normalize_avx512);
+
+inline void softmax_online(const float* input, float* output, size_t K)
+{
+    float max_val, sum;
+    maxsum(input, K, max_val, sum);
+    normalize(input, output, K, max_val, sum);
+}
+
+// log-sum-exp merge of two (max, sum) pairs computed on disjoint parts
+inline void online_merge(float max_other, float sum_other, float& max_val,
+                         float& sum)
+{
+    if (sum_other == 0.0f)
+        return;
+
+    float m = std::max(max_val, max_other);
+    sum = sum * std::exp(max_val - m) + sum_other * std::exp(max_other - m);
+    max_val = m;
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef SOFTMAX_PAR_HPP
+#define SOFTMAX_PAR_HPP
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <sched.h>
+
+#include "softmax_online.hpp"
+
+// Multithreaded softmax for very large K, in two parallel phases:
+//
+//  1. every thread computes the online (max, sum) pair of its block, the
+//     pairs are merged with the log-sum-exp rule
+//     M = max(m_t), S = sum(s_t * exp(m_t - M));
+//  2. every thread normalizes its block with the global (M, S).
+//
+// The blocks are the same in both phases and in the first-touch of the
+// arrays, and thread t is always pinned to the same core, so on a NUMA
+// machine every thread works on pages of its own node. The cores are taken
+// from the ones the caller may run on (taskset, cgroups), and the caller gets
+// its own affinity back once the team is done.
+
+// below this many elements per thread the team costs more than it saves
+constexpr size_t par_min_work = 1 << 16;
+
+// blocks are multiples of a cache line, threads never share one
+constexpr size_t par_line = 64 / sizeof(float);
+
+struct block
+{
+    size_t begin, end;
+};
+
+inline block block_of(size_t id, size_t threads, size_t K)
+{
+    size_t lines = (K + par_line - 1) / par_line;
+    size_t begin = std::min(K, lines * id / threads * par_line);
+    size_t end = std::min(K, lines * (id + 1) / threads * par_line);
+    return {begin, end};
+}
+
+// the CPUs in `set`, in increasing order
+inline std::vector<int> cpus_of(const cpu_set_t& set)
+{
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+    return cpus;
+}
+
+inline size_t team_size(size_t threads, size_t K)
+{
+    if (threads == 0)
+    {
+        cpu_set_t set;
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+            threads = CPU_COUNT(&set);
+        else
+            threads = std::thread::hardware_concurrency();
+        threads = std::max<size_t>(1, threads);
+    }
+    return std::min(threads, std::max<size_t>(1, K / par_min_work));
+}
+
+// pins the calling thread to `cpu`, false if it could not be moved there
+inline bool pin_thread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+// runs func(id) on `threads` pinned threads, the caller is thread 0. A thread
+// that cannot be pinned runs wherever the scheduler puts it
+template <typename Func>
+void parallel(size_t threads, Func&& func)
+{
+    cpu_set_t caller;
+    std::vector<int> cpus;
+    if (sched_getaffinity(0, sizeof(caller), &caller) == 0)
+        cpus = cpus_of(caller);
+    auto pin = [&](size_t id) {
+        return !cpus.empty() && pin_thread(cpus[id % cpus.size()]);
+    };
+
+    // the team is created before the caller is pinned, so that it starts
+    // from the caller's own affinity
+    std::vector<std::thread> team;
+    team.reserve(threads - 1);
+    for (size_t id = 1; id < threads; id++)
+    {
+        team.emplace_back(
+            [&](size_t id) {
+                pin(id);
+                func(id);
+            },
+            id);
+    }
+    bool pinned = pin(0);
+    func(0);
+    if (pinned)
+        sched_setaffinity(0, sizeof(caller), &caller);
+
+    for (auto& t : team)
+        t.join();
+}
+
+/**
+ * @brief allocates K floats aligned to a cache line whose pages are first
+ * touched by the thread that will process them.
+ */
+inline float* allocate_first_touch(size_t K, size_t threads)
+{
+    size_t bytes = (K * sizeof(float) + 63) / 64 * 64;
+    float* data = static_cast<float*>(std::aligned_alloc(64, bytes));
+
+    threads = team_size(threads, K);
+    parallel(threads, [&](size_t id) {
+        block b = block_of(id, threads, K);
+        std::memset(&data[b.begin], 0, (b.end - b.begin) * sizeof(float));
+    });
+
+    return data;
+}
+
+inline void softmax_par(const float* input, float* output, size_t K,
+                        size_t threads = 0)
+{
+    threads = team_size(threads, K);
+    std::vector<float> maxs(threads), sums(threads);
+
+    // phase 1: partial (max, sum) of every block
+    parallel(threads, [&](size_t id) {
+        block b = block_of(id, threads, K);
+        maxsum(&input[b.begin], b.end - b.begin, maxs[id], sums[id]);
+    });
+
+    float max_val = -std::numeric_limits<float>::infinity();
+    float sum = 0.0f;
+    for (size_t id = 0; id < threads; id++)
+        online_merge(maxs[id], sums[id], max_val, sum);
+
+    // phase 2: normalize every block with the global pair
+    parallel(threads, [&](size_t id) {
+        block b = block_of(id, threads, K);
+        normalize(&input[b.begin], &output[b.begin], b.end - b.begin, max_val,
+                  sum);
+    });
+}
+
+#endif
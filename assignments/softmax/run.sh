@@ -1,13 +1,17 @@
 #!/bin/bash
 
+# powers of two from 2^7 to 2^24: the largest ones do not fit the L2 cache
+SIZES=$(for p in {7..24}; do echo $((1 << p)); done)
 
 # run all simulations and save results
 make -j 2>&1 | grep softmax_auto.cpp
-for j in {128,256,512,1024,2048,4096,8192,16384}; do
+for j in $SIZES; do
     for i in {0..49}; do
-        ./softmax_plain.out $j 1 1>> plain_times_$j.txt 2>> plain_res_$j.txt
-        # ./softmax_auto.out $j 1 1>> auto_times_$j.txt 2>> auto_res_$j.txt
-        ./softmax_avx.out $j 1 1>> avx_times_$j.txt 2>> avx_res_$j.txt
+        ./softmax_plain.out $j 1>> plain_times_$j.txt
+        # ./softmax_auto.out $j 1>> auto_times_$j.txt
+        ./softmax_avx.out $j 1>> avx_times_$j.txt
+        ./softmax_online_avx.out $j 1>> online_times_$j.txt
+        ./softmax_par.out $j 1>> par_times_$j.txt
     done
 done
 
@@ -15,20 +19,15 @@ RED="\e[31m"
 GREEN="\e[32m"
 RESET="\e[0m"
 
-# check that every program compute the same result
-function compare_results() {
-    diff $1 $2 > /dev/null 2>&1
-    if [[ $? != 0 ]]; then
-        echo -e "${RED}$1 - $2: failed${RESET}"
+# check every variant against a long double reference, on every ISA path;
+# softmax_validate prints its errors and exits with 1 when one is too large
+for isa in scalar sse avx2 avx512; do
+    if report=$(SPM_ISA=$isa ./softmax_validate.out 0); then
+        echo -e "${GREEN}$isa: passed${RESET}"
     else
-        echo -e "${GREEN}$1 - $2: passed${RESET}"
+        echo "$report" | grep FAIL
+        echo -e "${RED}$isa: failed${RESET}"
     fi
-}
-
-for j in {128,256,512,1024,2048,4096,8192,16384}; do
-    # compare_results plain_res_$j.txt auto_res_$j.txt
-    compare_results plain_res_$j.txt avx_res_$j.txt
-    # compare_results auto_res_$j.txt avx_res_$j.txt
     echo "---------------"
 done
 
@@ -0,0 +1,65 @@
+#include <random>
+#include <vector>
+
+#include "hpc_helpers.hpp"
+#include "softmax_batched.hpp"
+
+std::vector<float> generate_random_input(size_t K, float min = -1.0f,
+                                         float max = 1.0f)
+{
+    std::vector<float> input(K);
+    std::mt19937 gen(5489); // fixed seed for reproducible results
+    std::uniform_real_distribution<float> dis(min, max);
+    for (size_t i = 0; i < K; ++i)
+    {
+        input[i] = dis(gen);
+    }
+    return input;
+}
+
+void printResult(std::vector<float>& v, size_t rows, size_t K, size_t ld)
+{
+    for (size_t r = 0; r < rows; ++r)
+    {
+        for (size_t i = 0; i < K; ++i)
+        {
+            std::fprintf(stderr, "%f\n", v[r * ld + i]);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::printf("use: %s rows K [threads] [1]\n", argv[0]);
+        return 0;
+    }
+    size_t rows = std::stol(argv[1]);
+    size_t K = std::stol(argv[2]);
+    size_t threads = 0;
+    if (argc >= 4)
+    {
+        threads = std::stol(argv[3]);
+    }
+    bool print = false;
+    if (argc == 5)
+    {
+        print = true;
+    }
+
+    // every row starts on a 64 bytes boundary of the matrix
+    size_t ld = (K + 15) / 16 * 16;
+    std::vector<float> input = generate_random_input(rows * ld);
+    std::vector<float> output(rows * ld);
+
+    TIMERSTART(softime_batched);
+    softmax_batched(input.data(), output.data(), rows, K, ld, threads);
+    TIMERSTOP(softime_batched);
+
+    // print the results on the standard output
+    if (print)
+    {
+        printResult(output, rows, K, ld);
+    }
+}
@@ -0,0 +1,111 @@
+#include <cmath>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "hpc_helpers.hpp"
+#include "softmax_mixed.hpp"
+#include "softmax_plain.hpp"
+
+std::vector<float> generate_random_input(size_t K, float min = -1.0f,
+                                         float max = 1.0f)
+{
+    std::vector<float> input(K);
+    std::mt19937 gen(5489); // fixed seed for reproducible results
+    std::uniform_real_distribution<float> dis(min, max);
+    for (size_t i = 0; i < K; ++i)
+    {
+        input[i] = dis(gen);
+    }
+    return input;
+}
+
+void printResult(std::vector<float>& v, size_t K)
+{
+    for (size_t i = 0; i < K; ++i)
+    {
+        std::fprintf(stderr, "%f\n", v[i]);
+    }
+}
+
+/**
+ * @brief runs softmax_mixed<In, Out> on the random input rounded to In and
+ * compares it with softmax_plain computed on the same rounded values,
+ * so that only the error of the kernel (and of the output type) is measured.
+ */
+template <typename In, typename Out>
+void run(size_t K, bool print)
+{
+    std::vector<float> values = generate_random_input(K);
+    std::vector<In> input(K);
+    std::vector<Out> output(K);
+    std::vector<float> rounded(K), result(K), reference(K);
+
+    // the input as the model would hand it over
+    if constexpr (std::is_same<In, float>::value)
+        input = values;
+    else
+        store_tile(values.data(), input.data(), K);
+    const float* x = load_tile(input.data(), rounded.data(), K);
+
+    TIMERSTART(softime_mixed);
+    softmax_mixed(input.data(), output.data(), K);
+    TIMERSTOP(softime_mixed);
+
+    softmax_plain(x, reference.data(), K);
+    const float* y = load_tile(output.data(), result.data(), K);
+
+    double max_abs = 0.0, max_rel = 0.0;
+    for (size_t i = 0; i < K; i++)
+    {
+        double err = std::fabs(double(y[i]) - reference[i]);
+        max_abs = std::max(max_abs, err);
+        if (reference[i] > 0.0f)
+            max_rel = std::max(max_rel, err / reference[i]);
+    }
+    std::printf("# max error against fp32: abs %g rel %g\n", max_abs, max_rel);
+
+    // print the results on the standard output
+    if (print)
+    {
+        std::vector<float> out(y, y + K);
+        printResult(out, K);
+    }
+}
+
+template <typename In>
+void run(const std::string& out, size_t K, bool print)
+{
+    if (out == "bf16")
+        run<In, bf16>(K, print);
+    else if (out == "fp16")
+        run<In, fp16>(K, print);
+    else
+        run<In, float>(K, print);
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 1)
+    {
+        std::printf("use: %s K [bf16|fp16|fp32] [bf16|fp16|fp32] [1]\n",
+                    argv[0]);
+        return 0;
+    }
+    size_t K = std::stol(argv[1]);
+    std::string in = argc >= 3 ? argv[2] : "bf16";
+    std::string out = argc >= 4 ? argv[3] : "fp32";
+    bool print = false;
+    if (argc == 5)
+    {
+        print = true;
+    }
+
+    if (in == "bf16")
+        run<bf16>(out, K, print);
+    else if (in == "fp16")
+        run<fp16>(out, K, print);
+    else
+        run<float>(out, K, print);
+}
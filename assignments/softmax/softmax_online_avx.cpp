@@ -0,0 +1,57 @@
+#include <random>
+#include <vector>
+
+#include "hpc_helpers.hpp"
+#include "softmax_online.hpp"
+
+std::vector<float> generate_random_input(size_t K, float min = -1.0f,
+                                         float max = 1.0f)
+{
+    std::vector<float> input(K);
+    std::mt19937 gen(5489); // fixed seed for reproducible results
+    std::uniform_real_distribution<float> dis(min, max);
+    for (size_t i = 0; i < K; ++i)
+    {
+        input[i] = dis(gen);
+    }
+    return input;
+}
+
+void printResult(std::vector<float>& v, size_t K)
+{
+    for (size_t i = 0; i < K; ++i)
+    {
+        std::fprintf(stderr, "%f\n", v[i]);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 1)
+    {
+        std::printf("use: %s K [1]\n", argv[0]);
+        return 0;
+    }
+    size_t K = 0;
+    if (argc >= 2)
+    {
+        K = std::stol(argv[1]);
+    }
+    bool print = false;
+    if (argc == 3)
+    {
+        print = true;
+    }
+    std::vector<float> input = generate_random_input(K);
+    std::vector<float> output(K);
+
+    TIMERSTART(softime_online);
+    softmax_online(input.data(), output.data(), K);
+    TIMERSTOP(softime_online);
+
+    // print the results on the standard output
+    if (print)
+    {
+        printResult(output, K);
+    }
+}
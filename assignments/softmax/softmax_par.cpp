@@ -0,0 +1,62 @@
+#include <cstdlib>
+#include <random>
+
+#include "hpc_helpers.hpp"
+#include "softmax_par.hpp"
+
+void generate_random_input(float* input, size_t K, float min = -1.0f,
+                           float max = 1.0f)
+{
+    std::mt19937 gen(5489); // fixed seed for reproducible results
+    std::uniform_real_distribution<float> dis(min, max);
+    for (size_t i = 0; i < K; ++i)
+    {
+        input[i] = dis(gen);
+    }
+}
+
+void printResult(const float* v, size_t K)
+{
+    for (size_t i = 0; i < K; ++i)
+    {
+        std::fprintf(stderr, "%f\n", v[i]);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 1)
+    {
+        std::printf("use: %s K [threads] [1]\n", argv[0]);
+        return 0;
+    }
+    size_t K = std::stol(argv[1]);
+    size_t threads = 0;
+    if (argc >= 3)
+    {
+        threads = std::stol(argv[2]);
+    }
+    bool print = false;
+    if (argc == 4)
+    {
+        print = true;
+    }
+
+    // the pages are placed by the first touch, the values written after
+    float* input = allocate_first_touch(K, threads);
+    float* output = allocate_first_touch(K, threads);
+    generate_random_input(input, K);
+
+    TIMERSTART(softime_par);
+    softmax_par(input, output, K, threads);
+    TIMERSTOP(softime_par);
+
+    // print the results on the standard output
+    if (print)
+    {
+        printResult(output, K);
+    }
+
+    std::free(input);
+    std::free(output);
+}
@@ -0,0 +1,230 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "softmax_avx.hpp"
+#include "softmax_batched.hpp"
+#include "softmax_mixed.hpp"
+#include "softmax_par.hpp"
+#include "softmax_plain.hpp"
+
+// Accuracy and throughput of every softmax variant in a single binary.
+//
+//  - accuracy: max absolute, relative and ULP error against a long double
+//    reference, on the benchmark input and on adversarial ones, for sizes
+//    that exercise every vector tail;
+//  - throughput: GB/s (one read of the input and one write of the output)
+//    and elements per ns over the sizes of run.sh.
+//
+// Nothing is written to disk. The vector kernels are the ones of the ISA
+// selected at startup, run with SPM_ISA=scalar|sse|avx2|avx512 to check the
+// other paths. The exit status is 1 when some variant is out of tolerance,
+// relative or in ULPs.
+
+using softmax_fn = void (*)(const float*, float*, size_t);
+
+struct variant
+{
+    const char* name;
+    softmax_fn run;
+};
+
+void softmax_batched_row(const float* input, float* output, size_t K)
+{
+    softmax_batched(input, output, 1, K, K, 1);
+}
+
+void softmax_par_all(const float* input, float* output, size_t K)
+{
+    softmax_par(input, output, K, 0);
+}
+
+void softmax_mixed_fp32(const float* input, float* output, size_t K)
+{
+    softmax_mixed(input, output, K);
+}
+
+const variant variants[] = {
+    {"plain", softmax_plain},
+    {"avx", softmax_avx},
+    {"online", softmax_online},
+    {"mixed", softmax_mixed_fp32},
+    {"batched", softmax_batched_row},
+    {"par", softmax_par_all},
+};
+
+void softmax_reference(const float* input, long double* output, size_t K)
+{
+    float max_val = -std::numeric_limits<float>::infinity();
+    for (size_t i = 0; i < K; i++)
+        max_val = std::max(max_val, input[i]);
+
+    long double sum = 0.0L;
+    for (size_t i = 0; i < K; i++)
+    {
+        output[i] = std::exp((long double)input[i] - max_val);
+        sum += output[i];
+    }
+
+    for (size_t i = 0; i < K; i++)
+        output[i] /= sum;
+}
+
+/**
+ * @brief the inputs of the accuracy checks. uniform is the one of the
+ * benchmarks, the others stress the max subtraction, the -inf handling, the
+ * exact ties and the underflow of the exponentials.
+ */
+std::vector<float> generate_input(const std::string& kind, size_t K)
+{
+    std::vector<float> input(K);
+    std::mt19937 gen(5489); // fixed seed for reproducible results
+    std::uniform_real_distribution<float> dis(-1.0f, 1.0f);
+
+    for (size_t i = 0; i < K; i++)
+    {
+        if (kind == "uniform")
+            input[i] = dis(gen);
+        else if (kind == "wide") // most exponentials underflow
+            input[i] = dis(gen) * 1e4f;
+        else if (kind == "offset") // exp(x) alone would overflow
+            input[i] = dis(gen) + 1e4f;
+        else if (kind == "neg_inf")
+            input[i] = i % 7 == 3 ? -std::numeric_limits<float>::infinity()
+                                  : dis(gen);
+        else if (kind == "equal")
+            input[i] = 3.0f;
+        else if (kind == "spike") // one output close to 1, the others tiny
+            input[i] = i == K / 2 ? 100.0f : 0.0f;
+    }
+    return input;
+}
+
+struct error
+{
+    double abs = 0.0, rel = 0.0, ulp = 0.0;
+};
+
+/**
+ * @brief the relative and ULP errors are taken only where the exact result
+ * is a normal float: below it the kernels flush or clamp by design and only
+ * the absolute error is meaningful. A NaN where the reference is a number is
+ * an infinite error.
+ */
+error measure(const float* output, const long double* reference, size_t K)
+{
+    error e;
+    const double inf = std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < K; i++)
+    {
+        long double r = reference[i];
+        long double d = std::fabs(output[i] - r);
+        if (std::isnan(output[i]) && !std::isnan(r))
+            d = inf;
+
+        e.abs = std::max(e.abs, double(d));
+        if (r >= std::numeric_limits<float>::min())
+        {
+            long double ulp = std::ldexp(1.0L, std::ilogb(r) - 23);
+            e.rel = std::max(e.rel, double(d / r));
+            e.ulp = std::max(e.ulp, double(d / ulp));
+        }
+    }
+    return e;
+}
+
+// best time of several runs, at least 3 and at least ~0.1 s
+double time_of(softmax_fn run, const float* input, float* output, size_t K)
+{
+    using clock = std::chrono::steady_clock;
+    double best = std::numeric_limits<double>::infinity(), total = 0.0;
+    for (int rep = 0; rep < 3 || (total < 0.1 && rep < 1000); rep++)
+    {
+        auto start = clock::now();
+        run(input, output, K);
+        std::chrono::duration<double> t = clock::now() - start;
+        best = std::min(best, t.count());
+        total += t.count();
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 4)
+    {
+        std::printf("use: %s [max_exp] [rel_tolerance] [ulp_tolerance]\n",
+                    argv[0]);
+        return 0;
+    }
+    int max_exp = argc >= 2 ? std::stoi(argv[1]) : 24;
+    double tolerance = argc >= 3 ? std::stod(argv[2]) : 1e-5;
+    double ulp_tolerance = argc >= 4 ? std::stod(argv[3]) : 256;
+
+    std::printf("# vector kernels: %s\n", spm::isa_name(spm::selected_isa()));
+
+    // sizes around every vector width, plus large ones for the sums
+    const size_t sizes[] = {1, 7, 8, 15, 17, 1000, 4099, 100003, 1 << 20};
+    const char* inputs[] = {"uniform", "wide",  "offset",
+                            "neg_inf", "equal", "spike"};
+
+    // growth of the tolerances with K, reached at K = 2^18
+    const double max_growth = 16;
+
+    bool failed = false;
+    std::printf("# accuracy against long double, rel tolerance %g, ulp "
+                "tolerance %g (x sqrt(K) / 32 above K = 1024, at most x %g)\n",
+                tolerance, ulp_tolerance, max_growth);
+    std::printf("%-8s %-8s %8s %10s %10s %10s\n", "variant", "input", "K",
+                "max_abs", "max_rel", "max_ulp");
+    for (const char* kind : inputs)
+    {
+        for (size_t K : sizes)
+        {
+            std::vector<float> input = generate_input(kind, K);
+            std::vector<long double> reference(K);
+            softmax_reference(input.data(), reference.data(), K);
+
+            // the rounding error of an fp32 sum grows about like sqrt(K), the
+            // cap keeps a drifting sum from hiding behind a huge K
+            double growth =
+                std::min(std::max(1.0, std::sqrt(K) / 32), max_growth);
+            double limit = tolerance * growth;
+            double ulp_limit = ulp_tolerance * growth;
+
+            for (const variant& v : variants)
+            {
+                std::vector<float> output(K);
+                v.run(input.data(), output.data(), K);
+                error e = measure(output.data(), reference.data(), K);
+
+                bool ok = e.rel <= limit && e.abs <= limit &&
+                          e.ulp <= ulp_limit;
+                failed |= !ok;
+                std::printf("%-8s %-8s %8zu %10.3g %10.3g %10.3g%s\n", v.name,
+                            kind, K, e.abs, e.rel, e.ulp, ok ? "" : "  FAIL");
+            }
+        }
+    }
+
+    std::printf("# throughput, uniform input, best of the runs\n");
+    std::printf("%-8s %8s %12s %8s %8s\n", "variant", "K", "time(s)", "GB/s",
+                "elem/ns");
+    for (int p = 7; p <= max_exp; p++)
+    {
+        size_t K = size_t(1) << p;
+        std::vector<float> input = generate_input("uniform", K);
+        std::vector<float> output(K);
+        for (const variant& v : variants)
+        {
+            double t = time_of(v.run, input.data(), output.data(), K);
+            std::printf("%-8s %8zu %12.6g %8.2f %8.3f\n", v.name, K, t,
+                        2.0 * K * sizeof(float) / t * 1e-9, K / t * 1e-9);
+        }
+    }
+
+    return failed ? 1 : 0;
+}
@@ -31,6 +31,7 @@ struct Task {
     size_t            cmp_size=0;    // output size
     size_t            blockid=1;     // block identifier (for "BIG files")
     size_t            nblocks=1;     // #blocks in which a "BIG file" is split
+    bool              pooled=false;  // ptr is a buffer of smallPool(), not mapped
     const std::string filename;      // source file name  
 };
 
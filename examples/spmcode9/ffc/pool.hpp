@@ -0,0 +1,61 @@
+/*
+ * Simple file compressor/decompressor using Miniz and the FastFlow
+ * building blocks
+ *
+ * Miniz source code: https://github.com/richgel999/miniz
+ * https://code.google.com/archive/p/miniz/
+ *
+ * FastFlow: https://github.com/fastflow/fastflow
+ *
+ * Author: Massimo Torquati <massimo.torquati@unipi.it>
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the author be held liable for any damages
+ * arising from the use of this software.
+ * Permission is granted to anyone to use this software for any purpose.
+ *
+ */
+#if !defined _POOL_HPP
+#define _POOL_HPP
+
+#include <mutex>
+#include <vector>
+#include <utility.hpp>
+
+// pool of buffers of the same size, filled by the Reader and given back by
+// the Workers: the buffers are allocated once and then reused from one
+// small file to the next, instead of mapping and unmapping every file
+struct BufferPool {
+    BufferPool(size_t bufSize): bufSize(bufSize) {}
+    ~BufferPool() {
+	for(unsigned char *b: freeBufs) delete [] b;
+    }
+
+    unsigned char *get() {
+	{
+	    std::lock_guard<std::mutex> lock(mtx);
+	    if (!freeBufs.empty()) {
+		unsigned char *b = freeBufs.back();
+		freeBufs.pop_back();
+		return b;
+	    }
+	}
+	return new unsigned char[bufSize];
+    }
+    void put(unsigned char *b) {
+	std::lock_guard<std::mutex> lock(mtx);
+	freeBufs.push_back(b);
+    }
+
+    const size_t                bufSize;
+    std::mutex                  mtx;
+    std::vector<unsigned char*> freeBufs;
+};
+
+// the pool of the files of at most SMALLFILE_THRESHOLD bytes
+static inline BufferPool &smallPool() {
+    static BufferPool pool(SMALLFILE_THRESHOLD);
+    return pool;
+}
+
+#endif // _POOL_HPP
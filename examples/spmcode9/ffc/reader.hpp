@@ -20,6 +20,7 @@
 
 #include <ff/ff.hpp>
 #include <datatask.hpp>
+#include <pool.hpp>
 
 // reader node, this is the "Emitter" of the FastFlow farm 
 struct Read: ff::ff_node_t<Task> {
@@ -28,6 +29,18 @@ struct Read: ff::ff_node_t<Task> {
     // ------------------- utility functions 
     bool doWorkCompress(const std::string& fname, size_t size) {
 		unsigned char *ptr = nullptr;
+		if (size<= SMALLFILE_THRESHOLD) {
+			// a buffer of the pool costs less than a mmap/munmap
+			ptr = smallPool().get();
+			if (!readFile(fname.c_str(), size, ptr)) {
+				smallPool().put(ptr);
+				return false;
+			}
+			Task *t = new Task(ptr, size, fname);
+			t->pooled=true;
+			ff_send_out(t); // sending to the next stage
+			return true;
+		}
 		if (!mapFile(fname.c_str(), size, ptr)) return false;
 		if (size<= BIGFILE_LOW_THRESHOLD) {
 			Task *t = new Task(ptr, size, fname);
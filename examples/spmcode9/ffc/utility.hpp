@@ -32,6 +32,7 @@
 #include <ftw.h>
 
 #include <algorithm>
+#include <memory>
 #include <string>
 #include <stdexcept>
 
@@ -45,6 +46,7 @@
 // global variables with their default values -------------------------------------------------
 static bool comp = true;                      // by default, it compresses 
 static size_t BIGFILE_LOW_THRESHOLD=2097152;  // 2Mbytes threshold 
+static size_t SMALLFILE_THRESHOLD=65536;      // smaller files are read, not mapped
 static bool REMOVE_ORIGIN=false;              // Does it keep the origin file?
 static int  QUITE_MODE=1;                     // 0 silent, 1 only errors, 2 everything
 static bool RECUR= false;                     // do we have to process the contents of subdirs?
@@ -96,6 +98,32 @@ static inline void unmapFile(unsigned char *ptr, size_t size) {
 	}
     }
 }
+// read the size bytes of the file fname into ptr
+static inline bool readFile(const char fname[], size_t size, unsigned char *ptr) {
+    int fd = open(fname,O_RDONLY);
+    if (fd<0) {
+	if (QUITE_MODE>=1) {
+	    perror("readFile open");
+	    std::fprintf(stderr, "Failed opening file %s\n", fname);
+	}
+	return false;
+    }
+    while(size>0) {
+	ssize_t r = read(fd, ptr, size);
+	if (r<=0) {
+	    if (QUITE_MODE>=1) {
+		perror("read");
+		std::fprintf(stderr, "Failed reading file %s\n", fname);
+	    }
+	    close(fd);
+	    return false;
+	}
+	ptr  += r;
+	size -= r;
+    }
+    close(fd);
+    return true;
+}
 // write size bytes starting from ptr into filename
 static inline bool writeFile(const std::string &filename, unsigned char *ptr, size_t size) {
     FILE *pOutfile = fopen(filename.c_str(), "wb");
@@ -272,16 +300,46 @@ static inline int checkHeader(const char fname[]) {
     return 0;
 }
     
+// inflate stream and buffers of decompressFile, a Worker keeps its own
+// and reuses them for all the files it decompresses
+struct InflateContext {
+    InflateContext() {
+	memset(&stream, 0, sizeof(stream));
+	ok = (inflateInit(&stream) == Z_OK);
+	inbuf  = new unsigned char[BUF_SIZE];
+	outbuf = new unsigned char[BUF_SIZE];
+    }
+    ~InflateContext() {
+	if (ok) inflateEnd(&stream);
+	delete [] inbuf;
+	delete [] outbuf;
+    }
+    InflateContext(const InflateContext&) = delete;
+    InflateContext& operator=(const InflateContext&) = delete;
+
+    z_stream       stream;
+    unsigned char *inbuf;
+    unsigned char *outbuf;
+    bool           ok;
+};
+
 // uncompress the input file (fname) having size infile_size
 // it returns 0 for success and -1 if something went wrong
 // if removeOrigin is true, the input compressed file will be removed if successfully uncompressed
+// if ctx is nullptr, the stream and the buffers are allocated for this file only
 static inline int decompressFile(const char fname[], size_t infile_size,
-				 const bool removeOrigin=REMOVE_ORIGIN) {
-    unsigned char *s_inbuf  = new unsigned char[BUF_SIZE];
-    unsigned char *s_outbuf = new unsigned char[BUF_SIZE];
-    assert(s_inbuf); assert(s_outbuf);
-    FILE *pInfile;
-    FILE *pOutfile;
+				 const bool removeOrigin=REMOVE_ORIGIN,
+				 InflateContext *ctx=nullptr) {
+    std::unique_ptr<InflateContext> tmpctx;
+    if (!ctx) {
+	tmpctx.reset(new InflateContext);
+	ctx = tmpctx.get();
+    }
+    unsigned char *s_inbuf  = ctx->inbuf;
+    unsigned char *s_outbuf = ctx->outbuf;
+    z_stream &stream        = ctx->stream;
+    FILE *pInfile  = nullptr;
+    FILE *pOutfile = nullptr;
     size_t infile_remaining = 0;
     char *fnameOut = nullptr;
     int n=0;
@@ -307,9 +365,7 @@ static inline int decompressFile(const char fname[], size_t infile_size,
     else     outfilename = infilename + "_decomp";
     fnameOut = const_cast<char *>(outfilename.c_str());
 
-    z_stream stream;
     // Init the z_stream
-    memset(&stream, 0, sizeof(stream));
     stream.next_in = s_inbuf;
     stream.avail_in = 0;
     stream.next_out = s_outbuf;
@@ -327,9 +383,10 @@ static inline int decompressFile(const char fname[], size_t infile_size,
 	infile_size=statbuf.st_size;
     }
     infile_remaining = infile_size;
-    if (inflateInit(&stream)) {
+    // the stream may have been used for another file
+    if (!ctx->ok || inflateReset(&stream) != Z_OK) {
 	if (QUITE_MODE>=1) 
-	    std::fprintf(stderr, "inflateInit() failed!\n");
+	    std::fprintf(stderr, "inflateReset() failed!\n");
 	goto dcpError;;
     }
     // Open output file.
@@ -377,19 +434,10 @@ static inline int decompressFile(const char fname[], size_t infile_size,
 	  goto dcpError;;
       }
     }// for
-    if (inflateEnd(&stream) != Z_OK) {
-	if (QUITE_MODE>=1)
-	    std::fprintf(stderr, "inflateEnd() failed!\n");
-	goto dcpError;;
-    }
     fclose(pInfile); fclose(pOutfile);
     if (n>0 && removeOrigin) removeFile(fname);
-    delete [] s_inbuf;
-    delete [] s_outbuf;
     return 0;
  dcpError:
-    delete [] s_inbuf;
-    delete [] s_outbuf;
     if (pInfile)  fclose(pInfile);
     if (pOutfile) fclose(pOutfile);
     return -1;
@@ -21,11 +21,27 @@
 #include <datatask.hpp>
 #include <ff/ff.hpp>
 #include <miniz.h>
+#include <pool.hpp>
 #include <string>
 #include <utility.hpp>
+#include <vector>
 
 struct Worker : ff::ff_node_t<Task>
 {
+    // the deflate stream is initialized once and reset for every task, the
+    // output buffer grows to the largest block and is then reused
+    int svc_init()
+    {
+        memset(&dstream, 0, sizeof(dstream));
+        if (deflateInit(&dstream, Z_DEFAULT_COMPRESSION) != Z_OK)
+        {
+            if (QUITE_MODE >= 1)
+                std::fprintf(stderr, "deflateInit() failed!\n");
+            return -1;
+        }
+        dinit = true;
+        return 0;
+    }
     Task* svc(Task* task)
     {
         bool oneblockfile = (task->nblocks == 1);
@@ -36,20 +52,30 @@ struct Worker : ff::ff_node_t<Task>
 
             // get an estimation of the maximum compression size
             unsigned long cmp_len = compressBound(inSize);
-            // allocate memory to store compressed data in memory
-            unsigned char* ptrOut = new unsigned char[cmp_len];
-            if (compress(ptrOut, &cmp_len, (const unsigned char*)inPtr,
-                         inSize) != Z_OK)
+            if (outBuf.size() < cmp_len)
+                outBuf.resize(cmp_len);
+            if (deflateReset(&dstream) != Z_OK)
+            {
+                if (QUITE_MODE >= 1)
+                    std::fprintf(stderr, "deflateReset() failed!\n");
+                success = false;
+                release(task);
+                return GO_ON;
+            }
+            dstream.next_in = inPtr;
+            dstream.avail_in = inSize;
+            dstream.next_out = outBuf.data();
+            dstream.avail_out = outBuf.size();
+            if (deflate(&dstream, Z_FINISH) != Z_STREAM_END)
             {
                 if (QUITE_MODE >= 1)
                     std::fprintf(stderr, "Failed to compress file in memory\n");
                 success = false;
-                delete[] ptrOut;
-                delete task;
+                release(task);
                 return GO_ON;
             }
-            task->ptrOut = ptrOut;
-            task->cmp_size = cmp_len; // real length
+            // the Writer does not need the data, the buffer stays here
+            task->cmp_size = dstream.total_out; // real length
             std::string outfile{task->filename};
             if (!oneblockfile)
             {
@@ -58,15 +84,17 @@ struct Worker : ff::ff_node_t<Task>
             outfile += SUFFIX;
 
             // write the compressed data into disk
-            bool s = writeFile(outfile, task->ptrOut, task->cmp_size);
+            bool s = writeFile(outfile, outBuf.data(), task->cmp_size);
             if (s && REMOVE_ORIGIN && oneblockfile)
             {
                 unlink(task->filename.c_str());
             }
             if (oneblockfile)
             {
-                unmapFile(task->ptr, task->size);
-                delete[] task->ptrOut;
+                if (task->pooled)
+                    smallPool().put(task->ptr);
+                else
+                    unmapFile(task->ptr, task->size);
                 delete task;
                 return GO_ON;
             }
@@ -79,14 +107,14 @@ struct Worker : ff::ff_node_t<Task>
                     std::fprintf(stderr, "Error writing file %s\n",
                                  task->filename.c_str());
                 success = false;
-                delete[] task->ptrOut;
                 delete task;
             }
             return GO_ON;
         }
         // decompression part
         bool remove = !oneblockfile || REMOVE_ORIGIN;
-        if (decompressFile(task->filename.c_str(), task->size, remove) == -1)
+        if (decompressFile(task->filename.c_str(), task->size, remove,
+                           &ictx) == -1)
         {
             if (QUITE_MODE >= 1)
                 std::fprintf(stderr, "Error decompressing file %s\n",
@@ -102,6 +130,11 @@ struct Worker : ff::ff_node_t<Task>
     }
     void svc_end()
     {
+        if (dinit)
+        {
+            deflateEnd(&dstream);
+            dinit = false;
+        }
         if (!success)
         {
             if (QUITE_MODE >= 1)
@@ -111,7 +144,19 @@ struct Worker : ff::ff_node_t<Task>
             return;
         }
     }
+    // a task that failed, its pooled buffer goes back to the pool
+    void release(Task* task)
+    {
+        if (task->pooled)
+            smallPool().put(task->ptr);
+        delete task;
+    }
+
     bool success = true;
+    z_stream dstream;
+    bool dinit = false;
+    std::vector<unsigned char> outBuf;
+    InflateContext ictx;
 };
 
 #endif // _WORKER_HPP
@@ -0,0 +1,102 @@
+#ifndef ISA_HPP
+#define ISA_HPP
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace spm
+{
+
+/**
+ * @brief x86 vector extensions a kernel can be specialized for, ordered so
+ * that every level implies the previous ones.
+ */
+enum class isa
+{
+    scalar = 0,
+    sse = 1,    // SSE4.2
+    avx2 = 2,   // AVX2 + FMA + F16C
+    avx512 = 3, // AVX-512 F
+};
+
+inline const char* isa_name(isa level)
+{
+    static const char* names[] = {"scalar", "sse", "avx2", "avx512"};
+    return names[static_cast<int>(level)];
+}
+
+/**
+ * @brief the widest level supported by the CPU, from CPUID.
+ */
+inline isa detect_isa()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return isa::avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") &&
+        __builtin_cpu_supports("f16c"))
+        return isa::avx2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return isa::sse;
+    return isa::scalar;
+}
+
+/**
+ * @brief the level used by the kernels, chosen once at the first call: the
+ * detected one, unless the environment variable SPM_ISA (scalar, sse, avx2 or
+ * avx512) asks for a narrower one to benchmark it. A level the CPU does not
+ * support is never selected.
+ */
+inline isa selected_isa()
+{
+    static const isa selected = []() {
+        isa best = detect_isa();
+        const char* env = std::getenv("SPM_ISA");
+        if (env == nullptr)
+            return best;
+
+        for (int i = 0; i <= static_cast<int>(isa::avx512); i++)
+        {
+            isa level = static_cast<isa>(i);
+            if (std::strcmp(env, isa_name(level)) != 0)
+                continue;
+
+            if (level > best)
+            {
+                std::fprintf(stderr, "SPM_ISA=%s not supported, using %s\n",
+                             env, isa_name(best));
+                return best;
+            }
+            return level;
+        }
+
+        std::fprintf(stderr, "SPM_ISA=%s unknown, using %s\n", env,
+                     isa_name(best));
+        return best;
+    }();
+
+    return selected;
+}
+
+/**
+ * @brief picks among the versions of a kernel the widest one not above
+ * `selected_isa()`. A version can be nullptr when a level has no dedicated
+ * implementation, the next narrower one is used instead.
+ */
+template <typename Func>
+Func dispatch(Func scalar, Func sse, Func avx2, Func avx512)
+{
+    Func versions[] = {scalar, sse, avx2, avx512};
+    for (int i = static_cast<int>(selected_isa()); i > 0; i--)
+    {
+        if (versions[i] != nullptr)
+            return versions[i];
+    }
+
+    return scalar;
+}
+
+} // namespace spm
+
+#endif
@@ -1,10 +1,14 @@
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstdio>
 #include <cstdlib>
 #include <immintrin.h>
 #include <iostream>
 #include <random>
 
+#include "isa.hpp"
+
 void init(float* a, float* b, float* c, uint64_t n)
 {
     std::random_device rd;
@@ -25,6 +29,26 @@ void mult_add(float* a, float* b, float* c, float* res, size_t n)
         res[i] = a[i] * b[i] + c[i];
 }
 
+// the vector versions are compiled for their own ISA and the widest one the
+// CPU supports is chosen at startup (SPM_ISA=scalar|sse|avx2|avx512 to force
+// a narrower one)
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+
+// SSE has no fused instruction, the product is rounded before the add
+void mult_add_sse(float* a, float* b, float* c, float* res, size_t n)
+{
+    for (size_t i = 0; i < n; i += 4)
+    {
+        __m128 va = _mm_load_ps(&a[i]);
+        __m128 vb = _mm_load_ps(&b[i]);
+        __m128 vc = _mm_load_ps(&c[i]);
+        _mm_store_ps(&res[i], _mm_add_ps(_mm_mul_ps(va, vb), vc));
+    }
+}
+
+#pragma GCC target("avx2,fma")
+
 void fuse_mult_add(float* a, float* b, float* c, float* res, size_t n)
 {
     for (size_t i = 0; i < n; i += 8)
@@ -37,12 +61,33 @@ void fuse_mult_add(float* a, float* b, float* c, float* res, size_t n)
     }
 }
 
+#pragma GCC target("avx512f")
+
+void fuse_mult_add512(float* a, float* b, float* c, float* res, size_t n)
+{
+    for (size_t i = 0; i < n; i += 16)
+    {
+        __m512 va = _mm512_load_ps(&a[i]);
+        __m512 vb = _mm512_load_ps(&b[i]);
+        __m512 vc = _mm512_load_ps(&c[i]);
+        _mm512_store_ps(&res[i], _mm512_fmadd_ps(va, vb, vc));
+    }
+}
+
+#pragma GCC pop_options
+
+using mult_add_fn = void (*)(float*, float*, float*, float*, size_t);
+
+const mult_add_fn mult_add_simd = spm::dispatch<mult_add_fn>(
+    mult_add, mult_add_sse, fuse_mult_add, fuse_mult_add512);
+
 void compare(float* a, float* b)
 {
     uint32_t mismatch = 0;
     for (size_t i = 0; i < 8; i++)
     {
-        if (std::fabs(a[i] - b[i]) > 1e-6) // fma is more precise than plain
+        // fma is more precise than plain, compare with a relative tolerance
+        if (std::fabs(a[i] - b[i]) > 1e-6 * std::fabs(a[i]))
         {
             mismatch++;
             std::printf("mismatch at index %lu: %.6f != %.6f\n", i, a[i], b[i]);
@@ -59,12 +104,14 @@ int main(int argc, const char** argv)
     size_t k = 1UL << 20;
     if (argc > 1)
         k = 1UL << std::atoi(argv[1]);
+    // the vector loops have no tail
+    k = std::max<size_t>(k, 16);
 
-    float* a = static_cast<float*>(_mm_malloc(k * sizeof(float), 32));
-    float* b = static_cast<float*>(_mm_malloc(k * sizeof(float), 32));
-    float* c = static_cast<float*>(_mm_malloc(k * sizeof(float), 32));
-    float* res1 = static_cast<float*>(_mm_malloc(k * sizeof(float), 32));
-    float* res2 = static_cast<float*>(_mm_malloc(k * sizeof(float), 32));
+    float* a = static_cast<float*>(_mm_malloc(k * sizeof(float), 64));
+    float* b = static_cast<float*>(_mm_malloc(k * sizeof(float), 64));
+    float* c = static_cast<float*>(_mm_malloc(k * sizeof(float), 64));
+    float* res1 = static_cast<float*>(_mm_malloc(k * sizeof(float), 64));
+    float* res2 = static_cast<float*>(_mm_malloc(k * sizeof(float), 64));
 
     init(a, b, c, k);
 
@@ -75,10 +122,11 @@ int main(int argc, const char** argv)
     std::printf("plain mult add time: %f\n", duration.count());
 
     start = std::chrono::high_resolution_clock::now();
-    fuse_mult_add(a, b, c, res2, k);
+    mult_add_simd(a, b, c, res2, k);
     end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> duration2 = end - start;
-    std::printf("fused mult add time: %f\n", duration2.count());
+    std::printf("%s mult add time: %f\n",
+                spm::isa_name(spm::selected_isa()), duration2.count());
 
     std::printf("speed up: %f\n", duration.count() / duration2.count());
 
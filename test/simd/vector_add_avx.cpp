@@ -2,6 +2,8 @@
 #include <immintrin.h>
 #include <random>
 
+#include "isa.hpp"
+
 void init(float *a, float *b, uint64_t n)
 {
     std::random_device rd;
@@ -27,6 +29,40 @@ void vadd(float *a, float *b, float *c, uint64_t n)
         c[i] = a[i] + b[i];
 }
 
+// the vector versions are compiled for their own ISA and the widest one the
+// CPU supports is chosen at startup (SPM_ISA=scalar|sse|avx2|avx512 to force
+// a narrower one)
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+
+void vadd128(float *a, float *b, float *c, uint64_t n)
+{
+    uint64_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 va = _mm_loadu_ps(&a[i]);
+        __m128 vb = _mm_loadu_ps(&b[i]);
+        _mm_storeu_ps(&c[i], _mm_add_ps(va, vb));
+    }
+    for (; i < n; i++)
+        c[i] = a[i] + b[i];
+}
+
+void vadd128_aligned(float *a, float *b, float *c, uint64_t n)
+{
+    uint64_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 va = _mm_load_ps(&a[i]);
+        __m128 vb = _mm_load_ps(&b[i]);
+        _mm_store_ps(&c[i], _mm_add_ps(va, vb));
+    }
+    for (; i < n; i++)
+        c[i] = a[i] + b[i];
+}
+
+#pragma GCC target("avx2")
+
 void vadd256(float *a, float *b, float *c, uint64_t n)
 {
     for (uint64_t i = 0; i < n; i += 8)
@@ -49,12 +85,49 @@ void vadd256_aligned(float *a, float *b, float *c, uint64_t n)
     }
 }
 
+#pragma GCC target("avx512f")
+
+void vadd512(float *a, float *b, float *c, uint64_t n)
+{
+    for (uint64_t i = 0; i < n; i += 16)
+    {
+        __mmask16 m = (n - i >= 16) ? 0xffff : (1u << (n - i)) - 1;
+        __m512 va = _mm512_maskz_loadu_ps(m, &a[i]);
+        __m512 vb = _mm512_maskz_loadu_ps(m, &b[i]);
+        _mm512_mask_storeu_ps(&c[i], m, _mm512_add_ps(va, vb));
+    }
+}
+
+void vadd512_aligned(float *a, float *b, float *c, uint64_t n)
+{
+    uint64_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 va = _mm512_load_ps(&a[i]);
+        __m512 vb = _mm512_load_ps(&b[i]);
+        _mm512_store_ps(&c[i], _mm512_add_ps(va, vb));
+    }
+    for (; i < n; i++)
+        c[i] = a[i] + b[i];
+}
+
+#pragma GCC pop_options
+
+using vadd_fn = void (*)(float *, float *, float *, uint64_t);
+
+const vadd_fn vadd_simd =
+    spm::dispatch<vadd_fn>(vadd, vadd128, vadd256, vadd512);
+const vadd_fn vadd_simd_aligned = spm::dispatch<vadd_fn>(
+    vadd, vadd128_aligned, vadd256_aligned, vadd512_aligned);
+
 int main(int argc, const char **argv)
 {
     uint64_t e = argc <= 1 ? 20UL : std::atoi(argv[1]);
     uint64_t n = 1 << e;
     double size = (double)(n * sizeof(float)) / (1024 * 1024);
     std::printf("array size: %lu -> %g MB\n", n, size);
+    const char *isa = spm::isa_name(spm::selected_isa());
+    std::printf("vector kernels: %s\n", isa);
 
     float *a = new float[n];
     float *b = new float[n];
@@ -73,14 +146,14 @@ int main(int argc, const char **argv)
     std::printf("plain elapsed time: %f seconds\n", plain.count());
 
     start = std::chrono::high_resolution_clock::now();
-    vadd256(a, b, c, n);
+    vadd_simd(a, b, c, n);
     end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> avx = end - start;
-    std::printf("avx unaligned elapsed time: %f seconds\n", avx.count());
+    std::printf("%s unaligned elapsed time: %f seconds\n", isa, avx.count());
 
-    float *a2 = static_cast<float *>(_mm_malloc(n * sizeof(float), 32));
-    float *b2 = static_cast<float *>(_mm_malloc(n * sizeof(float), 32));
-    float *c2 = static_cast<float *>(_mm_malloc(n * sizeof(float), 32));
+    float *a2 = static_cast<float *>(_mm_malloc(n * sizeof(float), 64));
+    float *b2 = static_cast<float *>(_mm_malloc(n * sizeof(float), 64));
+    float *c2 = static_cast<float *>(_mm_malloc(n * sizeof(float), 64));
     init(a2, b2, n);
 
     start = std::chrono::high_resolution_clock::now();
@@ -90,14 +163,15 @@ int main(int argc, const char **argv)
     std::printf("plain aligned elapsed time: %f seconds\n", plain.count());
 
     start = std::chrono::high_resolution_clock::now();
-    vadd256_aligned(a2, b2, c2, n);
+    vadd_simd_aligned(a2, b2, c2, n);
     end = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double> avx_aligned = end - start;
-    std::printf("avx aligned elapsed time: %f seconds\n", avx_aligned.count());
+    std::printf("%s aligned elapsed time: %f seconds\n", isa,
+                avx_aligned.count());
 
-    std::printf("plain to avx unaligned speed-up: %f\n",
+    std::printf("plain to %s unaligned speed-up: %f\n", isa,
                 plain.count() / avx.count());
-    std::printf("plain to avx aligned speed-up: %f\n",
+    std::printf("plain to %s aligned speed-up: %f\n", isa,
                 plain.count() / avx_aligned.count());
 
     delete[] a;